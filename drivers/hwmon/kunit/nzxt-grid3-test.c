@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests and benchmark of the status report decoder of nzxt-grid3.
+ */
+
+#include "nzxt-test.h"
+
+#include "../nzxt-grid3.c"
+
+/*
+ * The status report is 20 bytes after its ID, per the descriptor of 1e71:1714.
+ * Offsets are spelled out, rather than taken from the driver, so that the
+ * fixtures also check those.
+ */
+#define GRID3_TEST_REPORT_SIZE	21
+
+struct grid3_test_report {
+	const char *name;
+	u8 report[GRID3_TEST_REPORT_SIZE];
+	struct grid3_reading reading;
+};
+
+static const struct grid3_test_report grid3_test_reports[] = {
+	{
+		.name = "first channel, pwm",
+		.report = {
+			[0] = REPORT_STATUS,
+			[3] = 0x03, 0xe8,		/* 1000 rpm, big-endian */
+			[7] = 12, 0,			/* 12.00 V */
+			[9] = 0, 15,			/* 0.15 A */
+			[15] = 0 << 4 | PWM_FAN,
+		},
+		.reading = {
+			.rpms = 1000, .centivolts = 1200, .centiamps = 15,
+			.fan_type = PWM_FAN, .channel = 0,
+		},
+	},
+	{
+		.name = "last grid+ v3 channel, dc",
+		.report = {
+			[0] = REPORT_STATUS,
+			[3] = 0x05, 0xdc,		/* 1500 rpm */
+			[7] = 7, 45,			/* 7.45 V */
+			[9] = 1, 2,			/* 1.02 A */
+			[15] = 5 << 4 | DC_FAN,
+		},
+		.reading = {
+			.rpms = 1500, .centivolts = 745, .centiamps = 102,
+			.fan_type = DC_FAN, .channel = 5,
+		},
+	},
+	{
+		/* The upper bits of the low nibble aren't part of the fan type */
+		.name = "no fan, high bits",
+		.report = {
+			[0] = REPORT_STATUS,
+			[7] = 12, 5,
+			[15] = 2 << 4 | 0xc,
+		},
+		.reading = { .centivolts = 1205, .fan_type = 0, .channel = 2 },
+	},
+	{
+		/* Not checked by the decoder; grid3_raw_event() drops it */
+		.name = "channel out of range",
+		.report = { [0] = REPORT_STATUS, [15] = 0xf << 4 | PWM_FAN },
+		.reading = { .fan_type = PWM_FAN, .channel = 0xf },
+	},
+};
+
+static void grid3_test_report_desc(const struct grid3_test_report *t, char *desc)
+{
+	strscpy(desc, t->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(grid3_decode, grid3_test_reports, grid3_test_report_desc);
+
+static void grid3_decode_test(struct kunit *test)
+{
+	const struct grid3_test_report *t = test->param_value;
+	struct grid3_reading reading;
+
+	grid3_decode_status(t->report, &reading);
+
+	KUNIT_EXPECT_EQ(test, reading.rpms, t->reading.rpms);
+	KUNIT_EXPECT_EQ(test, reading.centivolts, t->reading.centivolts);
+	KUNIT_EXPECT_EQ(test, reading.centiamps, t->reading.centiamps);
+	KUNIT_EXPECT_EQ(test, reading.fan_type, t->reading.fan_type);
+	KUNIT_EXPECT_EQ(test, reading.channel, t->reading.channel);
+}
+
+static void grid3_decode_bench(struct kunit *test)
+{
+	const struct grid3_test_report *t;
+	struct grid3_reading reading;
+	unsigned int i;
+	u64 start;
+
+	start = nzxt_test_bench_start(test);
+
+	for (i = 0; i < bench_reports; i++) {
+		t = &grid3_test_reports[i % ARRAY_SIZE(grid3_test_reports)];
+		grid3_decode_status(t->report, &reading);
+		barrier_data(&reading);
+	}
+
+	nzxt_test_bench_end(test, start);
+}
+
+static struct kunit_case grid3_test_cases[] = {
+	KUNIT_CASE_PARAM(grid3_decode_test, grid3_decode_gen_params),
+	KUNIT_CASE(grid3_decode_bench),
+	{ }
+};
+
+static struct kunit_suite grid3_test_suite = {
+	.name = "nzxt-grid3",
+	.test_cases = grid3_test_cases,
+};
+
+kunit_test_suite(grid3_test_suite);
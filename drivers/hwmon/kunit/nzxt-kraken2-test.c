@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests and benchmark of the status report decoder of nzxt-kraken2.
+ */
+
+#include "nzxt-test.h"
+
+#include "../nzxt-kraken2.c"
+
+/* The status report is 16 bytes after its ID, per the descriptor of 1e71:170e */
+#define KRAKEN2_TEST_REPORT_SIZE	17
+
+struct kraken2_test_report {
+	const char *name;
+	u8 report[KRAKEN2_TEST_REPORT_SIZE];
+	s32 temp_input;
+	u16 fan_input[2];
+};
+
+static const struct kraken2_test_report kraken2_test_reports[] = {
+	{
+		.name = "idle",
+		.report = { STATUS_REPORT_ID, 30, 5, 0x05, 0xdc, 0x07, 0xd0 },
+		.temp_input = 30500,
+		.fan_input = { 1500, 2000 },
+	},
+	{
+		.name = "full speed",
+		.report = { STATUS_REPORT_ID, 45, 9, 0x07, 0xd0, 0x0b, 0xb8 },
+		.temp_input = 45900,
+		.fan_input = { 2000, 3000 },
+	},
+	{
+		.name = "stopped",
+		.report = { STATUS_REPORT_ID, 24, 1 },
+		.temp_input = 24100,
+		.fan_input = { 0, 0 },
+	},
+	{
+		.name = "big-endian speeds",
+		.report = { STATUS_REPORT_ID, 0, 0, 0xff, 0x00, 0x00, 0xff },
+		.temp_input = 0,
+		.fan_input = { 0xff00, 0x00ff },
+	},
+};
+
+static void kraken2_test_report_desc(const struct kraken2_test_report *t, char *desc)
+{
+	strscpy(desc, t->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(kraken2_decode, kraken2_test_reports, kraken2_test_report_desc);
+
+static void kraken2_decode_test(struct kunit *test)
+{
+	const struct kraken2_test_report *t = test->param_value;
+	s32 temp_input[1];
+	u16 fan_input[2];
+
+	kraken2_decode_status(t->report, temp_input, fan_input);
+
+	KUNIT_EXPECT_EQ(test, temp_input[0], t->temp_input);
+	KUNIT_EXPECT_EQ(test, fan_input[0], t->fan_input[0]);
+	KUNIT_EXPECT_EQ(test, fan_input[1], t->fan_input[1]);
+}
+
+static void kraken2_decode_bench(struct kunit *test)
+{
+	const struct kraken2_test_report *t;
+	s32 temp_input[1];
+	u16 fan_input[2];
+	unsigned int i;
+	u64 start;
+
+	start = nzxt_test_bench_start(test);
+
+	for (i = 0; i < bench_reports; i++) {
+		t = &kraken2_test_reports[i % ARRAY_SIZE(kraken2_test_reports)];
+		kraken2_decode_status(t->report, temp_input, fan_input);
+		barrier_data(temp_input);
+		barrier_data(fan_input);
+	}
+
+	nzxt_test_bench_end(test, start);
+}
+
+static struct kunit_case kraken2_test_cases[] = {
+	KUNIT_CASE_PARAM(kraken2_decode_test, kraken2_decode_gen_params),
+	KUNIT_CASE(kraken2_decode_bench),
+	{ }
+};
+
+static struct kunit_suite kraken2_test_suite = {
+	.name = "nzxt-kraken2",
+	.test_cases = kraken2_test_cases,
+};
+
+kunit_test_suite(kraken2_test_suite);
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests and benchmark of the status report decoder of nzxt-kraken3.
+ */
+
+#include "nzxt-test.h"
+
+#include "../nzxt-kraken3.c"
+
+/*
+ * Reports fill the 64 bytes of the interrupt endpoint. Offsets are spelled out, rather than taken
+ * from the driver, so that the fixtures also check those.
+ */
+#define KRAKEN3_TEST_REPORT_SIZE	64
+
+struct kraken3_test_report {
+	const char *name;
+	const struct kraken3_model *model;
+	u8 report[KRAKEN3_TEST_REPORT_SIZE];
+	bool valid;
+	s32 temp_input;
+	u16 fan_input[2];
+	u16 reported_duty[2];
+};
+
+static const struct kraken3_test_report kraken3_test_reports[] = {
+	{
+		.name = "x53",
+		.model = &kraken3_x53,
+		.report = {
+			[0] = STATUS_REPORT_ID,
+			[15] = 31, [16] = 4,
+			[17] = 0x98, [18] = 0x08,
+			[19] = 60,
+			/* Not a fan on this model, so ignored */
+			[23] = 0x84, [25] = 40,
+		},
+		.valid = true,
+		.temp_input = 31400,
+		.fan_input = { 2200, 0 },
+		.reported_duty = { 153, 0 },
+	},
+	{
+		.name = "z53",
+		.model = &kraken3_z53,
+		.report = {
+			[0] = STATUS_REPORT_ID,
+			[15] = 31, [16] = 4,
+			[17] = 0x98, [18] = 0x08,
+			[19] = 60,
+			[23] = 0x84, [24] = 0x03,
+			[25] = 40,
+		},
+		.valid = true,
+		.temp_input = 31400,
+		.fan_input = { 2200, 900 },
+		.reported_duty = { 153, 102 },
+	},
+	{
+		.name = "2023 extreme duties",
+		.model = &kraken3_2023,
+		.report = {
+			[0] = STATUS_REPORT_ID,
+			[15] = 52, [16] = 9,
+			[17] = 0xc4, [18] = 0x09,
+			[19] = 100,
+		},
+		.valid = true,
+		.temp_input = 52900,
+		.fan_input = { 2500, 0 },
+		.reported_duty = { 255, 0 },
+	},
+	{
+		/* Reported by devices without SATA power, or with a damaged firmware */
+		.name = "faulty",
+		.model = &kraken3_2023_elite,
+		.report = {
+			[0] = STATUS_REPORT_ID,
+			[15] = 0xff, [16] = 0xff,
+			[17] = 0x98, [18] = 0x08,
+		},
+		.valid = false,
+	},
+};
+
+static void kraken3_test_report_desc(const struct kraken3_test_report *t, char *desc)
+{
+	strscpy(desc, t->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(kraken3_decode, kraken3_test_reports, kraken3_test_report_desc);
+
+static void kraken3_decode_test(struct kunit *test)
+{
+	const struct kraken3_test_report *t = test->param_value;
+	struct kraken3_status status, before;
+	int i;
+
+	/* Anything left over must be either cleared or, for faulty reports, kept as is */
+	memset(&status, 0xaa, sizeof(status));
+	before = status;
+
+	KUNIT_EXPECT_EQ(test, kraken3_decode_status(t->report, t->model, &status), t->valid);
+
+	if (!t->valid) {
+		KUNIT_EXPECT_MEMEQ(test, &status, &before, sizeof(status));
+		return;
+	}
+
+	KUNIT_EXPECT_EQ(test, status.temp_input[0], t->temp_input);
+	for (i = 0; i < ARRAY_SIZE(status.fan_input); i++) {
+		KUNIT_EXPECT_EQ(test, status.fan_input[i], t->fan_input[i]);
+		KUNIT_EXPECT_EQ(test, status.reported_duty[i], t->reported_duty[i]);
+	}
+	KUNIT_EXPECT_FALSE(test, status.is_device_faulty);
+}
+
+static void kraken3_decode_bench(struct kunit *test)
+{
+	const struct kraken3_test_report *t;
+	struct kraken3_status status;
+	unsigned int i;
+	u64 start;
+
+	start = nzxt_test_bench_start(test);
+
+	for (i = 0; i < bench_reports; i++) {
+		t = &kraken3_test_reports[i % ARRAY_SIZE(kraken3_test_reports)];
+		kraken3_decode_status(t->report, t->model, &status);
+		barrier_data(&status);
+	}
+
+	nzxt_test_bench_end(test, start);
+}
+
+static struct kunit_case kraken3_test_cases[] = {
+	KUNIT_CASE_PARAM(kraken3_decode_test, kraken3_decode_gen_params),
+	KUNIT_CASE(kraken3_decode_bench),
+	{ }
+};
+
+static struct kunit_suite kraken3_test_suite = {
+	.name = "nzxt-kraken3",
+	.test_cases = kraken3_test_cases,
+};
+
+kunit_test_suite(kraken3_test_suite);
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * KUnit tests and benchmark of the input report decoders of nzxt-smart2.
+ */
+
+#include "nzxt-test.h"
+
+#include "../nzxt-smart2.c"
+
+/*
+ * Reports fill the 64 bytes of the interrupt endpoint. Offsets are spelled
+ * out, rather than taken from the report structs of the driver, so that the
+ * fixtures also check those: fan types start at 16, and the two arrays of
+ * per-channel values of status reports at 24 and 40.
+ */
+#define SMART2_TEST_REPORT_SIZE	64
+
+struct smart2_test_report {
+	const char *name;
+	u8 report[SMART2_TEST_REPORT_SIZE];
+	bool valid;		/* For fan config reports */
+	u16 expected[2][FAN_CHANNELS];
+};
+
+static const struct smart2_test_report smart2_test_config_reports[] = {
+	{
+		.name = "pwm, dc, none",
+		.report = {
+			[0] = INPUT_REPORT_ID_FAN_CONFIG, [1] = 0x03,
+			[16] = FAN_TYPE_PWM, FAN_TYPE_DC, FAN_TYPE_NONE,
+			/* Channels the device doesn't have */
+			[19] = FAN_TYPE_PWM,
+		},
+		.valid = true,
+		.expected = { { FAN_TYPE_PWM, FAN_TYPE_DC, FAN_TYPE_NONE } },
+	},
+	{
+		.name = "bad magic",
+		.report = {
+			[0] = INPUT_REPORT_ID_FAN_CONFIG, [1] = 0x02,
+			[16] = FAN_TYPE_PWM, FAN_TYPE_PWM, FAN_TYPE_PWM,
+		},
+		.valid = false,
+	},
+};
+
+/* expected[0] is fan_rpm, expected[1] duty_percent */
+static const struct smart2_test_report smart2_test_speed_reports[] = {
+	{
+		.name = "little-endian speeds",
+		.report = {
+			[0] = INPUT_REPORT_ID_FAN_STATUS, [1] = FAN_STATUS_REPORT_SPEED,
+			[16] = FAN_TYPE_PWM, FAN_TYPE_DC, FAN_TYPE_NONE,
+			[24] = 0xb0, 0x04, 0x20, 0x03, 0x00, 0x00,
+			[40] = 50, 40, 40,
+		},
+		.expected = { { 1200, 800, 0 }, { 50, 40, 40 } },
+	},
+	{
+		.name = "full speed",
+		.report = {
+			[0] = INPUT_REPORT_ID_FAN_STATUS, [1] = FAN_STATUS_REPORT_SPEED,
+			[16] = FAN_TYPE_PWM, FAN_TYPE_PWM, FAN_TYPE_PWM,
+			[24] = 0xb8, 0x0b, 0xb8, 0x0b, 0xff, 0xff,
+			[40] = 100, 100, 100,
+		},
+		.expected = { { 3000, 3000, 65535 }, { 100, 100, 100 } },
+	},
+};
+
+/* expected[0] is fan_in, expected[1] fan_curr */
+static const struct smart2_test_report smart2_test_voltage_reports[] = {
+	{
+		.name = "12 V",
+		.report = {
+			[0] = INPUT_REPORT_ID_FAN_STATUS, [1] = FAN_STATUS_REPORT_VOLTAGE,
+			[16] = FAN_TYPE_PWM, FAN_TYPE_DC, FAN_TYPE_NONE,
+			[24] = 0xe0, 0x2e, 0x18, 0x2e, 0xe0, 0x2e,
+			[40] = 0x96, 0x00, 0x5a, 0x00, 0x00, 0x00,
+		},
+		.expected = { { 12000, 11800, 12000 }, { 150, 90, 0 } },
+	},
+};
+
+static void smart2_test_report_desc(const struct smart2_test_report *t, char *desc)
+{
+	strscpy(desc, t->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(smart2_config, smart2_test_config_reports, smart2_test_report_desc);
+KUNIT_ARRAY_PARAM(smart2_speed, smart2_test_speed_reports, smart2_test_report_desc);
+KUNIT_ARRAY_PARAM(smart2_voltage, smart2_test_voltage_reports, smart2_test_report_desc);
+
+static void smart2_config_test(struct kunit *test)
+{
+	const struct smart2_test_report *t = test->param_value;
+	u8 fan_type[FAN_CHANNELS];
+	int i;
+
+	KUNIT_EXPECT_EQ(test, decode_fan_config((const void *)t->report, fan_type), t->valid);
+
+	if (!t->valid)
+		return;
+
+	for (i = 0; i < FAN_CHANNELS; i++)
+		KUNIT_EXPECT_EQ(test, fan_type[i], t->expected[0][i]);
+}
+
+static void smart2_speed_test(struct kunit *test)
+{
+	const struct smart2_test_report *t = test->param_value;
+	u16 fan_rpm[FAN_CHANNELS];
+	u8 duty_percent[FAN_CHANNELS];
+	int i;
+
+	decode_fan_speed((const void *)t->report, fan_rpm, duty_percent);
+
+	for (i = 0; i < FAN_CHANNELS; i++) {
+		KUNIT_EXPECT_EQ(test, fan_rpm[i], t->expected[0][i]);
+		KUNIT_EXPECT_EQ(test, duty_percent[i], t->expected[1][i]);
+	}
+}
+
+static void smart2_voltage_test(struct kunit *test)
+{
+	const struct smart2_test_report *t = test->param_value;
+	u16 fan_in[FAN_CHANNELS], fan_curr[FAN_CHANNELS];
+	int i;
+
+	decode_fan_voltage((const void *)t->report, fan_in, fan_curr);
+
+	for (i = 0; i < FAN_CHANNELS; i++) {
+		KUNIT_EXPECT_EQ(test, fan_in[i], t->expected[0][i]);
+		KUNIT_EXPECT_EQ(test, fan_curr[i], t->expected[1][i]);
+	}
+}
+
+/* Like the device, alternates speed and voltage reports */
+static void smart2_decode_bench(struct kunit *test)
+{
+	u16 fan_rpm[FAN_CHANNELS], fan_in[FAN_CHANNELS], fan_curr[FAN_CHANNELS];
+	u8 duty_percent[FAN_CHANNELS];
+	const void *speed = smart2_test_speed_reports[0].report;
+	const void *voltage = smart2_test_voltage_reports[0].report;
+	unsigned int i;
+	u64 start;
+
+	start = nzxt_test_bench_start(test);
+
+	for (i = 0; i < bench_reports; i++) {
+		if (i % 2)
+			decode_fan_voltage(voltage, fan_in, fan_curr);
+		else
+			decode_fan_speed(speed, fan_rpm, duty_percent);
+		barrier_data(fan_rpm);
+		barrier_data(fan_in);
+	}
+
+	nzxt_test_bench_end(test, start);
+}
+
+static struct kunit_case smart2_test_cases[] = {
+	KUNIT_CASE_PARAM(smart2_config_test, smart2_config_gen_params),
+	KUNIT_CASE_PARAM(smart2_speed_test, smart2_speed_gen_params),
+	KUNIT_CASE_PARAM(smart2_voltage_test, smart2_voltage_gen_params),
+	KUNIT_CASE(smart2_decode_bench),
+	{ }
+};
+
+static struct kunit_suite smart2_test_suite = {
+	.name = "nzxt-smart2",
+	.test_cases = smart2_test_cases,
+};
+
+kunit_test_suite(smart2_test_suite);
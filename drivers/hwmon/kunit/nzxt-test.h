@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Shared by the KUnit tests of the NZXT HID hwmon drivers.
+ *
+ * Each test module includes the source of the driver it tests, to get at its static report
+ * decoders, and must include this header first. The driver is then built into the test module
+ * without registering itself with the HID core or matching any device, so that loading the test
+ * module never binds to real hardware.
+ *
+ * The fixtures are built from Documentation/internal: reports have the sizes given by the captured
+ * report descriptors (1e71:170e for the Kraken X42/X52/X62/X72, 1e71:1714 for the Smart Device)
+ * and, for devices without a capture, the 64 bytes of their interrupt endpoints.
+ */
+
+#ifndef _NZXT_TEST_H
+#define _NZXT_TEST_H
+
+#include <kunit/test.h>
+#include <linux/compiler.h>
+#include <linux/hid.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+
+/* Keep the driver from registering itself on load; the tests call its functions directly */
+#undef late_initcall
+#define late_initcall(fn)	static initcall_t __initdata __maybe_unused nzxt_test_initcall = fn
+#undef module_exit
+#define module_exit(fn)		static exitcall_t __exitdata __maybe_unused nzxt_test_exitcall = fn
+
+/* And keep the test module from being loaded for the devices of the driver */
+#undef MODULE_DEVICE_TABLE
+#define MODULE_DEVICE_TABLE(type, name)
+
+static unsigned int bench_reports;
+module_param(bench_reports, uint, 0444);
+MODULE_PARM_DESC(bench_reports,
+		 "Reports to decode in the benchmark cases, or 0 to skip them (default 0)");
+
+/**
+ * nzxt_test_bench_start() - Start timing a benchmark case.
+ * @test:	Test case.
+ *
+ * Skips the test case unless the bench_reports module parameter is set.
+ *
+ * Return: The start time, for nzxt_test_bench_end().
+ */
+static u64 nzxt_test_bench_start(struct kunit *test)
+{
+	if (!bench_reports)
+		kunit_skip(test, "bench_reports is 0");
+
+	return ktime_get_ns();
+}
+
+/**
+ * nzxt_test_bench_end() - Report the time per report of a benchmark case.
+ * @test:	Test case.
+ * @start:	Value returned by nzxt_test_bench_start().
+ */
+static void nzxt_test_bench_end(struct kunit *test, u64 start)
+{
+	u64 elapsed = ktime_get_ns() - start;
+
+	kunit_info(test, "%u reports in %llu ns, %llu ns/report\n", bench_reports, elapsed,
+		   div_u64(elapsed, bench_reports));
+}
+
+#endif /* _NZXT_TEST_H */
@@ -42,13 +42,23 @@
 #endif
 
 #include <linux/bitops.h>
+#include <linux/debugfs.h>
 #include <linux/errno.h>
+#include <linux/fs.h>
 #include <linux/hid.h>
 #include <linux/hwmon.h>
 #include <linux/jiffies.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
 #include <linux/minmax.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include "nzxt-hid-common.h"
+#include "nzxt-hid-trace.h"
 
 #define VID_NZXT		0x1e71
 #define PID_GRIDPLUS3		0x1711
@@ -59,7 +69,7 @@
 #define REQ_INIT_OPEN		0x5d
 
 #define REPORT_STATUS		0x04
-#define STATUS_VALIDITY		3 /* seconds */
+#define STATUS_VALIDITY		3 /* default, in seconds */
 
 #define REPORT_CONFIG		0x02
 #define CONFIG_FAN_PWM		0x4d
@@ -67,14 +77,64 @@
 #define DC_FAN			BIT(0)
 #define PWM_FAN			BIT(1)
 
+#define HISTORY_LEN		256 /* samples per channel, must be a power of 2 */
+#define MAX_CHANNELS		6
+
+/**
+ * struct grid3_sample - Status of a channel at some point, as read from debugfs.
+ * @timestamp:	Time the status report was received, in ns (CLOCK_MONOTONIC).
+ * @rpms:	Fan speed in rpm.
+ * @centiamps:	Fan current draw in centiamperes.
+ * @centivolts:	Fan supply voltage in centivolts.
+ * @fan_type:	Fan type (no fan, DC, PWM).
+ * @channel:	Channel number, starting from zero.
+ */
+struct grid3_sample {
+	__le64 timestamp;
+	__le16 rpms;
+	__le16 centiamps;
+	__le16 centivolts;
+	u8 fan_type;
+	u8 channel;
+} __packed;
+
+/**
+ * struct grid3_reading - Values decoded from a status report.
+ * @rpms:	Fan speed in rpm.
+ * @centiamps:	Fan current draw in centiamperes.
+ * @centivolts:	Fan supply voltage in centivolts.
+ * @fan_type:	Fan type (no fan, DC, PWM).
+ * @channel:	Channel number, starting from zero; not checked against the device.
+ */
+struct grid3_reading {
+	u16 rpms;
+	u16 centiamps;
+	u16 centivolts;
+	u8 fan_type;
+	u8 channel;
+};
+
 /**
  * struct grid3_channel_status - Last known data for a given channel.
  * @rpms:	Fan speed in rpm.
  * @centiamps:	Fan current draw in centiamperes.
  * @centivolts:	Fan supply voltage in centivolts.
- * @pwm:	Fan PWM value (last set value, device does not report it).
+ * @pwm:	Fan PWM value (last set value, device does not report it). Written
+ *		with WRITE_ONCE() by grid3_queue_pwm() without any lock, and by
+ *		grid3_output_work() under &grid3_data.lock once it is sent; read
+ *		locklessly.
+ * @pending_pwm: PWM value to be sent by grid3_output_work(), if the channel is
+ *		set in &grid3_data.pending_mask.
+ * @sent_percent: Duty cycle last sent to the device, in percent, if @sent_valid.
+ * @sent_valid:	Whether @sent_percent is known to be programmed in the device.
+ *		Both under &grid3_data.lock.
  * @fan_type:	Fan type (no fan, DC, PWM).
  * @updated:	Last update in jiffies.
+ * @history:	Samples not yet read from debugfs. Filled by grid3_raw_event();
+ *		single producer and consumer, so no lock is needed between them.
+ * @history_lock: Serializes debugfs readers of @history.
+ * @history_dropped: Number of samples dropped because @history was full.
+ * @cooling:	Optional thermal cooling device of the channel.
  *
  * Centiamperes and centivolts are used to save some space.
  */
@@ -83,26 +143,57 @@ struct grid3_channel_status {
 	u16 centiamps;
 	u16 centivolts;
 	u8 pwm;
+	u8 pending_pwm;
+	u8 sent_percent;
+	bool sent_valid;
 	u8 fan_type;
 	unsigned long updated;
+
+	DECLARE_KFIFO(history, struct grid3_sample, HISTORY_LEN);
+	struct mutex history_lock; /* see comment above */
+	unsigned long history_dropped;
+
+	struct nzxt_hid_cooling cooling;
 };
 
 /**
  * struct grid3_data - Driver private data.
  * @hid_dev:	HID device.
  * @hwmon_dev:	HWMON device.
- * @lock:	Protects the output buffer @out and writes to @status[].pwm.
- * @out:	DMA-safe output buffer for HID output reports.
+ * @iio_dev:	Optional IIO device.
+ * @debugfs:	Debugfs directory.
+ * @lock:	Orders the output reports that depend on each other, and protects
+ *		@status[].sent_percent and @status[].sent_valid. See
+ *		&grid3_channel_status.pwm for how @status[].pwm is accessed.
+ * @out:	Output report path.
+ * @output_work: Sends pending output reports, under @lock.
+ * @pending_lock: Protects @pending_mask and @status[].pending_pwm.
+ * @pending_mask: Channels with a PWM value waiting for @output_work.
+ * @init_pending: Whether @output_work should (re)initialize the device first.
+ * @pwm_reports_sent: Number of PWM output reports sent, under @lock.
+ * @pwm_reports_skipped: Number of PWM writes that didn't need a report, under @lock.
+ * @staleness:	For how long the status of each channel is served.
  * @channels:	Number of channels.
  * @status:	Last known status for each channel.
  */
 struct grid3_data {
 	struct hid_device *hid_dev;
 	struct device *hwmon_dev;
+	struct iio_dev *iio_dev;
+	struct dentry *debugfs;
 
 	struct mutex lock; /* see comment above */
-	u8 out[8];
+	struct nzxt_hid_out out;
+
+	struct work_struct output_work;
+	spinlock_t pending_lock; /* see comment above */
+	unsigned long pending_mask;
+	bool init_pending;
 
+	unsigned long pwm_reports_sent;
+	unsigned long pwm_reports_skipped;
+
+	struct nzxt_hid_staleness staleness;
 	int channels;
 	struct grid3_channel_status status[];
 };
@@ -138,7 +229,7 @@ static int grid3_read_pwm(struct grid3_data *priv, u32 attr, int channel, long *
 {
 	switch (attr) {
 	case hwmon_pwm_input:
-		*val = priv->status[channel].pwm;
+		*val = READ_ONCE(priv->status[channel].pwm);
 		break;
 	case hwmon_pwm_mode:
 		/*
@@ -157,10 +248,8 @@ static int grid3_read(struct device *dev, enum hwmon_sensor_types type, u32 attr
 		      int channel, long *val)
 {
 	struct grid3_data *priv = dev_get_drvdata(dev);
-	unsigned long expires;
 
-	expires = priv->status[channel].updated + STATUS_VALIDITY * HZ;
-	if (time_after(jiffies, expires))
+	if (nzxt_hid_is_expired(&priv->staleness, READ_ONCE(priv->status[channel].updated)))
 		return -ENODATA;
 
 	switch (type) {
@@ -184,48 +273,77 @@ static int grid3_read(struct device *dev, enum hwmon_sensor_types type, u32 attr
 
 /*
  * Caller must hold priv->lock or otherwise ensure exclusive access to
- * priv->out and priv->status[*].pwm.
+ * priv->status[*].sent_percent and priv->status[*].sent_valid.
  */
 static int grid3_write_pwm_assume_locked(struct grid3_data *priv, int channel, long val)
 {
+	struct grid3_channel_status *status = &priv->status[channel];
+	u8 report[5];
+	u8 percent;
 	int ret;
 
 	val = clamp_val(val, 0, 255);
+	percent = val * 100 / 255;
+
+	/* Nothing to send if the device already has this duty cycle */
+	if (status->sent_valid && status->sent_percent == percent) {
+		priv->pwm_reports_skipped++;
+		goto store;
+	}
 
-	priv->out[0] = REPORT_CONFIG;
-	priv->out[1] = CONFIG_FAN_PWM;
-	priv->out[2] = channel;
-	priv->out[3] = 0x00;
-	priv->out[4] = val * 100 / 255;
+	report[0] = REPORT_CONFIG;
+	report[1] = CONFIG_FAN_PWM;
+	report[2] = channel;
+	report[3] = 0x00;
+	report[4] = percent;
 
-	ret = hid_hw_output_report(priv->hid_dev, priv->out, 5);
-	if (ret < 0)
+	/* Until it's known to have been accepted */
+	status->sent_valid = false;
+
+	ret = nzxt_hid_send(&priv->out, report, sizeof(report));
+	if (ret)
 		return ret;
-	if (ret != 5)
-		return -EIO; /* FIXME */
 
+	status->sent_percent = percent;
+	status->sent_valid = true;
+	priv->pwm_reports_sent++;
+
+store:
 	/*
 	 * Store the value that was just set; the device does not support
 	 * reading it later, but user-space needs it.
 	 */
-	priv->status[channel].pwm = val;
+	WRITE_ONCE(priv->status[channel].pwm, val);
 
 	return 0;
 }
 
-static int grid3_write_pwm_input(struct device *dev, enum hwmon_sensor_types type,
-				 u32 attr, int channel, long val)
+/*
+ * PWM changes are only queued here, and sent by grid3_output_work(). A change
+ * that hasn't been sent yet is replaced by newer ones to the same channel.
+ */
+static int grid3_queue_pwm(void *data, int channel, long val)
 {
-	struct grid3_data *priv = dev_get_drvdata(dev);
-	int ret;
+	struct grid3_data *priv = data;
 
-	if (mutex_lock_interruptible(&priv->lock))
-		return -ERESTARTSYS;
+	val = clamp_val(val, 0, 255);
 
-	ret = grid3_write_pwm_assume_locked(priv, channel, val);
+	spin_lock_bh(&priv->pending_lock);
+	priv->status[channel].pending_pwm = val;
+	priv->pending_mask |= BIT(channel);
+	spin_unlock_bh(&priv->pending_lock);
 
-	mutex_unlock(&priv->lock);
-	return ret;
+	/* Report the new value right away, like the device would have taken it */
+	WRITE_ONCE(priv->status[channel].pwm, val);
+
+	schedule_work(&priv->output_work);
+	return 0;
+}
+
+static int grid3_write_pwm_input(struct device *dev, enum hwmon_sensor_types type,
+				 u32 attr, int channel, long val)
+{
+	return grid3_queue_pwm(dev_get_drvdata(dev), channel, val);
 }
 
 static const struct hwmon_ops grid3_hwmon_ops = {
@@ -271,50 +389,124 @@ static const struct hwmon_chip_info grid3_chip_info = {
 	.info = grid3_info,
 };
 
+/* Decodes a status report of at least 16 bytes, without touching any state */
+static void grid3_decode_status(const u8 *data, struct grid3_reading *reading)
+{
+	reading->rpms = get_unaligned_be16(data + 3);
+	reading->centiamps = data[9] * 100 + data[10];
+	reading->centivolts = data[7] * 100 + data[8];
+	reading->fan_type = data[15] & 0x3;
+	reading->channel = data[15] >> 4;
+}
+
+/* Speed, current and voltage of each channel, in order */
+#define GRID3_IIO_CHANNEL(ch)						\
+	NZXT_HID_IIO_CHAN(IIO_ANGL_VEL, ch, 3 * (ch)),			\
+	NZXT_HID_IIO_CHAN(IIO_CURRENT, ch, 3 * (ch) + 1),		\
+	NZXT_HID_IIO_CHAN(IIO_VOLTAGE, ch, 3 * (ch) + 2)
+
+static const struct iio_chan_spec grid3_iio_channels_3[] = {
+	GRID3_IIO_CHANNEL(0), GRID3_IIO_CHANNEL(1), GRID3_IIO_CHANNEL(2),
+	IIO_CHAN_SOFT_TIMESTAMP(9),
+};
+
+static const struct iio_chan_spec grid3_iio_channels_6[] = {
+	GRID3_IIO_CHANNEL(0), GRID3_IIO_CHANNEL(1), GRID3_IIO_CHANNEL(2),
+	GRID3_IIO_CHANNEL(3), GRID3_IIO_CHANNEL(4), GRID3_IIO_CHANNEL(5),
+	IIO_CHAN_SOFT_TIMESTAMP(18),
+};
+
+/*
+ * The device reports one channel at a time, so every report pushes a scan with
+ * the last known data of all channels.
+ */
+static void grid3_iio_push(struct grid3_data *priv)
+{
+	struct {
+		s32 values[3 * MAX_CHANNELS];
+		s64 timestamp __aligned(8);
+	} scan;
+	int i;
+
+	if (!priv->iio_dev)
+		return;
+
+	/* The whole scan is copied into the buffer, unused channels included */
+	memset(&scan, 0, sizeof(scan));
+	for (i = 0; i < priv->channels; i++) {
+		scan.values[3 * i] = priv->status[i].rpms;
+		scan.values[3 * i + 1] = priv->status[i].centiamps * 10;
+		scan.values[3 * i + 2] = priv->status[i].centivolts * 10;
+	}
+
+	nzxt_hid_iio_push(priv->iio_dev, scan.values);
+}
+
 static int grid3_raw_event(struct hid_device *hdev, struct hid_report *report,
 			   u8 *data, int size)
 {
+	struct grid3_channel_status *status;
+	struct grid3_reading reading;
+	struct grid3_sample sample;
 	struct grid3_data *priv;
 	int channel;
 
-	if (size < 16 || report->id != REPORT_STATUS)
+	trace_nzxt_hid_raw_event(hdev, report->id, size);
+
+	if (report->id != REPORT_STATUS || size < 16)
 		return 0;
 
 	priv = hid_get_drvdata(hdev);
 
-	channel = data[15] >> 4;
+	grid3_decode_status(data, &reading);
+	channel = reading.channel;
 
-	if (channel > priv->channels)
+	if (channel >= priv->channels)
 		return 0;
 
-	priv->status[channel].rpms = get_unaligned_be16(data + 3);
-	priv->status[channel].centiamps = data[9] * 100 + data[10];
-	priv->status[channel].centivolts = data[7] * 100 + data[8];
-	priv->status[channel].fan_type = data[15] & 0x3;
+	status = &priv->status[channel];
+
+	status->rpms = reading.rpms;
+	status->centiamps = reading.centiamps;
+	status->centivolts = reading.centivolts;
+	status->fan_type = reading.fan_type;
+
+	status->updated = jiffies;
 
-	priv->status[channel].updated = jiffies;
+	trace_nzxt_hid_sensor(hdev, NZXT_HID_FAN, channel, status->rpms);
+	trace_nzxt_hid_sensor(hdev, NZXT_HID_CURR, channel, status->centiamps * 10);
+	trace_nzxt_hid_sensor(hdev, NZXT_HID_IN, channel, status->centivolts * 10);
+
+	sample.timestamp = cpu_to_le64(ktime_get_ns());
+	sample.rpms = cpu_to_le16(status->rpms);
+	sample.centiamps = cpu_to_le16(status->centiamps);
+	sample.centivolts = cpu_to_le16(status->centivolts);
+	sample.fan_type = status->fan_type;
+	sample.channel = channel;
+
+	if (!kfifo_put(&status->history, sample))
+		status->history_dropped++;
+
+	grid3_iio_push(priv);
 
 	return 0;
 }
 
 /*
- * Caller must hold priv->lock or otherwise ensure exclusive access to
- * priv->out.
+ * Caller must hold priv->lock or otherwise ensure that nothing is sent in
+ * between.
  */
-static int grid3_req_init_assume_locked(struct hid_device *hdev, u8 *buf)
+static int grid3_req_init_assume_locked(struct grid3_data *priv)
 {
 	u8 cmds[2] = {REQ_INIT_DETECT, REQ_INIT_OPEN};
+	u8 report[2] = {REPORT_REQ_INIT};
 	int i, ret;
 
-	buf[0] = REPORT_REQ_INIT;
-
 	for (i = 0; i < ARRAY_SIZE(cmds); i++) {
-		buf[1] = cmds[i];
-		ret = hid_hw_output_report(hdev, buf, 2);
-		if (ret < 0)
+		report[1] = cmds[i];
+		ret = nzxt_hid_send(&priv->out, report, sizeof(report));
+		if (ret)
 			return ret;
-		if (ret != 2)
-			return -EIO; /* FIXME */
 	}
 
 	return 0;
@@ -322,13 +514,20 @@ static int grid3_req_init_assume_locked(struct hid_device *hdev, u8 *buf)
 
 /*
  * Caller must hold priv->lock or otherwise ensure exclusive access to
- * priv->out and priv->status[*].pwm.
+ * priv->status[*].sent_percent and priv->status[*].sent_valid.
  */
 static int grid3_driver_init_assume_locked(struct grid3_data *priv)
 {
 	int i, ret;
 
-	ret = grid3_req_init_assume_locked(priv->hid_dev, priv->out);
+	/*
+	 * Whatever was sent before, the device may have lost it (it comes back
+	 * from a reset at 40%), so resync every channel.
+	 */
+	for (i = 0; i < priv->channels; i++)
+		priv->status[i].sent_valid = false;
+
+	ret = grid3_req_init_assume_locked(priv);
 	if (ret) {
 		hid_err(priv->hid_dev, "request init failed with %d\n", ret);
 		return ret;
@@ -336,11 +535,11 @@ static int grid3_driver_init_assume_locked(struct grid3_data *priv)
 
 	for (i = 0; i < priv->channels; i++) {
 		/*
-		 * Initialize ->updated to STATUS_VALIDITY seconds in the past,
-		 * making the initial empty data invalid for grid3_read
-		 * without the need for a special case there.
+		 * Initialize ->updated far enough in the past, making the
+		 * initial empty data invalid for grid3_read without the need
+		 * for a special case there.
 		 */
-		priv->status[i].updated = jiffies - STATUS_VALIDITY * HZ;
+		priv->status[i].updated = nzxt_hid_never_updated();
 
 		/*
 		 * Mimic the behavior of the device after being powered on,
@@ -356,30 +555,183 @@ static int grid3_driver_init_assume_locked(struct grid3_data *priv)
 	return 0;
 }
 
-static int __maybe_unused grid3_reset_resume(struct hid_device *hdev)
+/*
+ * Drains the history of a channel, in whole struct grid3_sample records.
+ */
+static ssize_t grid3_history_read(struct file *file, char __user *buf, size_t count,
+				  loff_t *ppos)
 {
-	struct grid3_data *priv = hid_get_drvdata(hdev);
+	struct grid3_channel_status *status = file->private_data;
+	unsigned int copied;
 	int ret;
 
+	if (count < sizeof(struct grid3_sample))
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&status->history_lock))
+		return -ERESTARTSYS;
+
+	ret = kfifo_to_user(&status->history, buf, count, &copied);
+
+	mutex_unlock(&status->history_lock);
+	return ret ? ret : copied;
+}
+
+static const struct file_operations grid3_history_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = grid3_history_read,
+	.llseek = noop_llseek,
+};
+
+/*
+ * Shows the last known data of all channels at once, so that scraping the whole
+ * device takes a single read.
+ */
+static int status_show(struct seq_file *seqf, void *unused)
+{
+	struct grid3_data *priv = seqf->private;
+	struct grid3_channel_status *status;
+	unsigned long now = jiffies;
+	int i;
+
+	seq_puts(seqf, "channel rpm curr_ma in_mv pwm fan_type age_ms\n");
+
+	for (i = 0; i < priv->channels; i++) {
+		status = &priv->status[i];
+		seq_printf(seqf, "%d %u %u %u %u %u %u\n", i + 1, READ_ONCE(status->rpms),
+			   READ_ONCE(status->centiamps) * 10, READ_ONCE(status->centivolts) * 10,
+			   READ_ONCE(status->pwm), READ_ONCE(status->fan_type),
+			   jiffies_to_msecs(now - READ_ONCE(status->updated)));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(status);
+
+static int output_stats_show(struct seq_file *seqf, void *unused)
+{
+	struct grid3_data *priv = seqf->private;
+
+	nzxt_hid_show_stats(seqf, &priv->out);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(output_stats);
+
+static int age_show(struct seq_file *seqf, void *unused)
+{
+	struct grid3_data *priv = seqf->private;
+	char name[8];
+	int i;
+
+	for (i = 0; i < priv->channels; i++) {
+		scnprintf(name, sizeof(name), "fan%d", i + 1);
+		nzxt_hid_show_age(seqf, name, READ_ONCE(priv->status[i].updated));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(age);
+
+static void grid3_debugfs_init(struct grid3_data *priv, const char *hwmon_name)
+{
+	char name[64];
+	int i;
+
+	scnprintf(name, sizeof(name), "nzxt_grid3_%s-%s", hwmon_name,
+		  dev_name(&priv->hid_dev->dev));
+
+	priv->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_file("status", 0444, priv->debugfs, priv, &status_fops);
+	debugfs_create_file("output_stats", 0444, priv->debugfs, priv, &output_stats_fops);
+	debugfs_create_file("age_ms", 0444, priv->debugfs, priv, &age_fops);
+	nzxt_hid_staleness_debugfs(priv->debugfs, &priv->staleness);
+
+	debugfs_create_ulong("pwm_reports_sent", 0444, priv->debugfs, &priv->pwm_reports_sent);
+	debugfs_create_ulong("pwm_reports_skipped", 0444, priv->debugfs,
+			     &priv->pwm_reports_skipped);
+
+	for (i = 0; i < priv->channels; i++) {
+		scnprintf(name, sizeof(name), "channel%d_history", i + 1);
+		debugfs_create_file(name, 0400, priv->debugfs, &priv->status[i],
+				    &grid3_history_fops);
+
+		scnprintf(name, sizeof(name), "channel%d_history_dropped", i + 1);
+		debugfs_create_ulong(name, 0444, priv->debugfs,
+				     &priv->status[i].history_dropped);
+	}
+}
+
+static void grid3_output_work(struct work_struct *work)
+{
+	struct grid3_data *priv = container_of(work, struct grid3_data, output_work);
+	bool init_pending;
+	unsigned long mask;
+	int i, ret;
+	u8 pwm;
+
 	mutex_lock(&priv->lock);
-	ret = grid3_driver_init_assume_locked(priv);
+
+	spin_lock_bh(&priv->pending_lock);
+	init_pending = priv->init_pending;
+	priv->init_pending = false;
+	spin_unlock_bh(&priv->pending_lock);
+
+	if (init_pending) {
+		ret = grid3_driver_init_assume_locked(priv);
+		if (ret)
+			hid_err(priv->hid_dev, "driver init failed with %d\n", ret);
+	}
+
+	for (i = 0; i < priv->channels; i++) {
+		spin_lock_bh(&priv->pending_lock);
+		mask = priv->pending_mask;
+		priv->pending_mask &= ~BIT(i);
+		pwm = priv->status[i].pending_pwm;
+		spin_unlock_bh(&priv->pending_lock);
+
+		if (!(mask & BIT(i)))
+			continue;
+
+		ret = grid3_write_pwm_assume_locked(priv, i, pwm);
+		if (ret)
+			hid_err(priv->hid_dev, "write pwm failed with %d\n", ret);
+	}
+
 	mutex_unlock(&priv->lock);
+}
 
-	if (ret)
-		hid_err(hdev, "req init (reset_resume) failed with %d\n", ret);
+/*
+ * Queues the initialization of the device, followed by any PWM changes made in
+ * the meantime.
+ */
+static void grid3_queue_init(struct grid3_data *priv)
+{
+	spin_lock_bh(&priv->pending_lock);
+	priv->init_pending = true;
+	spin_unlock_bh(&priv->pending_lock);
 
-	return ret;
+	schedule_work(&priv->output_work);
+}
+
+static int __maybe_unused grid3_reset_resume(struct hid_device *hdev)
+{
+	struct grid3_data *priv = hid_get_drvdata(hdev);
+
+	grid3_queue_init(priv);
+
+	return 0;
 }
 
 static int grid3_probe(struct hid_device *hdev, const struct hid_device_id *id)
 {
 	struct grid3_data *priv;
 	char *hwmon_name;
-	int channels, ret;
+	int channels, ret, i;
 
 	switch (id->product) {
 	case PID_GRIDPLUS3:
-		channels = 6;
+		channels = MAX_CHANNELS;
 		hwmon_name = "gridplus3";
 		break;
 	case PID_SMARTDEVICE:
@@ -396,7 +748,26 @@ static int grid3_probe(struct hid_device *hdev, const struct hid_device_id *id)
 
 	priv->hid_dev = hdev;
 	priv->channels = channels;
+
+	ret = nzxt_hid_out_init(&priv->out, hdev, 8, false);
+	if (ret)
+		return ret;
+
+	if (channels == MAX_CHANNELS)
+		priv->iio_dev = nzxt_hid_iio_register(hdev, hwmon_name, grid3_iio_channels_6,
+						      ARRAY_SIZE(grid3_iio_channels_6));
+	else
+		priv->iio_dev = nzxt_hid_iio_register(hdev, hwmon_name, grid3_iio_channels_3,
+						      ARRAY_SIZE(grid3_iio_channels_3));
+
 	mutex_init(&priv->lock);
+	spin_lock_init(&priv->pending_lock);
+	INIT_WORK(&priv->output_work, grid3_output_work);
+
+	for (i = 0; i < channels; i++) {
+		INIT_KFIFO(priv->status[i].history);
+		mutex_init(&priv->status[i].history_lock);
+	}
 
 	hid_set_drvdata(hdev, priv);
 
@@ -422,14 +793,14 @@ static int grid3_probe(struct hid_device *hdev, const struct hid_device_id *id)
 	}
 
 	/*
-	 * Concurrent access to priv->out or priv->status[*].pwm is not
-	 * possible yet.
+	 * The init runs asynchronously in grid3_output_work(), so make the
+	 * initial empty data invalid for grid3_read right away.
 	 */
-	ret = grid3_driver_init_assume_locked(priv);
-	if (ret) {
-		hid_err(hdev, "driver init failed with %d\n", ret);
-		goto fail_hid_close;
-	}
+	priv->staleness.validity_ms = STATUS_VALIDITY * MSEC_PER_SEC;
+	for (i = 0; i < channels; i++)
+		priv->status[i].updated = nzxt_hid_never_updated();
+
+	grid3_queue_init(priv);
 
 	priv->hwmon_dev = hwmon_device_register_with_info(&hdev->dev, hwmon_name,
 							  priv, &grid3_chip_info,
@@ -437,12 +808,19 @@ static int grid3_probe(struct hid_device *hdev, const struct hid_device_id *id)
 	if (IS_ERR(priv->hwmon_dev)) {
 		ret = PTR_ERR(priv->hwmon_dev);
 		hid_err(hdev, "hwmon registration failed with %d\n", ret);
-		goto fail_hid_close;
+		goto fail_cancel_work;
 	}
 
+	for (i = 0; i < channels; i++)
+		nzxt_hid_cooling_register(hdev, &priv->status[i].cooling,
+					  "nzxt-grid3-fan", grid3_queue_pwm, priv, i);
+
+	grid3_debugfs_init(priv, hwmon_name);
+
 	return 0;
 
-fail_hid_close:
+fail_cancel_work:
+	cancel_work_sync(&priv->output_work);
 	hid_hw_close(hdev);
 fail_hid_stop:
 	hid_hw_stop(hdev);
@@ -454,8 +832,14 @@ fail_mutex_destroy:
 static void grid3_remove(struct hid_device *hdev)
 {
 	struct grid3_data *priv = hid_get_drvdata(hdev);
+	int i;
 
+	for (i = 0; i < priv->channels; i++)
+		nzxt_hid_cooling_unregister(&priv->status[i].cooling);
+
+	debugfs_remove_recursive(priv->debugfs);
 	hwmon_device_unregister(priv->hwmon_dev);
+	cancel_work_sync(&priv->output_work);
 
 	hid_hw_close(hdev);
 	hid_hw_stop(hdev);
@@ -471,11 +855,21 @@ static const struct hid_device_id grid3_table[] = {
 
 MODULE_DEVICE_TABLE(hid, grid3_table);
 
+/*
+ * The HID core only matches report types here; the report ID is checked in
+ * grid3_raw_event().
+ */
+static const struct hid_report_id grid3_report_table[] = {
+	{ HID_INPUT_REPORT },
+	{ HID_TERMINATOR }
+};
+
 static struct hid_driver grid3_driver = {
 	.name = "nzxt-grid3",
 	.id_table = grid3_table,
 	.probe = grid3_probe,
 	.remove = grid3_remove,
+	.report_table = grid3_report_table,
 	.raw_event = grid3_raw_event,
 #ifdef CONFIG_PM
 	.reset_resume = grid3_reset_resume,
@@ -0,0 +1,595 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Output report handling shared by the NZXT HID hwmon drivers.
+ *
+ * Each device gets a preallocated, DMA-safe buffer for its output reports.
+ * Errors and timing are accounted for in the same way for all drivers, so that
+ * they can show uniform statistics.
+ *
+ * The tracepoints of all drivers are defined here too, in nzxt-hid-trace.h, as well as the
+ * optional IIO devices that stream the decoded status reports with timestamps, and the optional
+ * thermal cooling devices that let in-kernel governors set the duty of fan and pump channels.
+ * So are the staleness policies, which decide for how long decoded status data is served.
+ */
+
+#include <linux/bitops.h>
+#include <linux/device.h>
+#include <linux/errno.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/kfifo_buf.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/minmax.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
+#include "nzxt-hid-common.h"
+
+#define CREATE_TRACE_POINTS
+#include "nzxt-hid-trace.h"
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(nzxt_hid_raw_event);
+EXPORT_TRACEPOINT_SYMBOL_GPL(nzxt_hid_sensor);
+EXPORT_TRACEPOINT_SYMBOL_GPL(nzxt_hid_status_request);
+EXPORT_TRACEPOINT_SYMBOL_GPL(nzxt_hid_status_complete);
+
+static bool iio;
+module_param(iio, bool, 0444);
+MODULE_PARM_DESC(iio, "Register an IIO device streaming timestamped samples for each device");
+
+static bool register_cooling;
+module_param_named(cooling, register_cooling, bool, 0444);
+MODULE_PARM_DESC(cooling, "Register controllable channels as thermal cooling devices");
+
+/* Caller must hold out->lock */
+static int nzxt_hid_send_buf(struct nzxt_hid_out *out, u8 *buf, size_t len)
+{
+	size_t report_len = out->pad ? out->size : len;
+	ktime_t start = ktime_get();
+	s64 duration;
+	int ret;
+
+	if (out->pad)
+		memset(buf + len, 0, out->size - len);
+
+	ret = hid_hw_output_report(out->hdev, buf, report_len);
+	duration = ktime_us_delta(ktime_get(), start);
+
+	nzxt_hid_hist_add(out->stats.send_time, duration);
+	trace_nzxt_hid_output_report(out->hdev, buf, report_len, ret, duration);
+
+	if (ret >= 0 && ret != report_len)
+		ret = -EIO;
+
+	if (ret < 0) {
+		atomic_long_inc(&out->stats.send_errors);
+		return ret;
+	}
+
+	atomic_long_inc(&out->stats.reports_sent);
+	return 0;
+}
+
+static void nzxt_hid_lock(struct nzxt_hid_out *out)
+{
+	ktime_t start = ktime_get();
+
+	mutex_lock(&out->lock);
+	nzxt_hid_hist_add(out->stats.lock_wait, ktime_us_delta(ktime_get(), start));
+}
+
+/**
+ * nzxt_hid_out_init() - Set up the output report path of a device.
+ * @out:	Output report path to initialize.
+ * @hdev:	HID device; the buffer is a device-managed resource of it.
+ * @size:	Size of the buffer, and of every report if @pad is set.
+ * @pad:	Whether to zero-pad shorter reports to @size.
+ *
+ * Return: 0 on success, or a negative error code.
+ */
+int nzxt_hid_out_init(struct nzxt_hid_out *out, struct hid_device *hdev, size_t size, bool pad)
+{
+	out->hdev = hdev;
+	out->size = size;
+	out->pad = pad;
+
+	out->buf = devm_kzalloc(&hdev->dev, size, GFP_KERNEL);
+	if (!out->buf)
+		return -ENOMEM;
+
+	mutex_init(&out->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_out_init);
+
+/**
+ * nzxt_hid_send() - Send an output report and wait for it to be sent.
+ * @out:	Output report path.
+ * @data:	Report, starting with its ID.
+ * @len:	Length of the report; at most the size of the buffers.
+ *
+ * Return: 0 on success, or a negative error code (-EIO if the report was only
+ * partially sent).
+ */
+int nzxt_hid_send(struct nzxt_hid_out *out, const void *data, size_t len)
+{
+	int ret;
+
+	if (len > out->size)
+		return -EINVAL;
+
+	nzxt_hid_lock(out);
+
+	memcpy(out->buf, data, len);
+	ret = nzxt_hid_send_buf(out, out->buf, len);
+
+	mutex_unlock(&out->lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_send);
+
+/**
+ * nzxt_hid_wait_for_reply() - Wait for a reply to be processed.
+ * @out:	Output report path the request was sent through.
+ * @done:	Completed once the reply has been processed.
+ * @timeout:	Timeout, in jiffies.
+ *
+ * Return: 0 once @done is completed, -ETIMEDOUT or -ERESTARTSYS.
+ */
+int nzxt_hid_wait_for_reply(struct nzxt_hid_out *out, struct completion *done,
+			    unsigned long timeout)
+{
+	long ret;
+
+	ret = wait_for_completion_interruptible_timeout(done, timeout);
+	if (ret == 0) {
+		atomic_long_inc(&out->stats.timeouts);
+		return -ETIMEDOUT;
+	} else if (ret < 0) {
+		atomic_long_inc(&out->stats.interrupted);
+		return ret;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_wait_for_reply);
+
+static const struct iio_info nzxt_hid_iio_info = { };
+
+/**
+ * nzxt_hid_iio_register() - Register an IIO device with a kfifo buffer, if enabled.
+ * @hdev:	HID device; the IIO device is a device-managed resource of it.
+ * @name:	Name of the IIO device.
+ * @channels:	Channels, made with NZXT_HID_IIO_CHAN(), in scan order and followed by a
+ *		timestamp channel.
+ * @num_channels: Number of channels, including the timestamp.
+ *
+ * All channels are always captured, and the IIO core hands userspace the ones it enabled.
+ * Failing to register isn't fatal for the drivers, so it's only logged.
+ *
+ * Return: the IIO device, or NULL if disabled or if registering failed.
+ */
+struct iio_dev *nzxt_hid_iio_register(struct hid_device *hdev, const char *name,
+				      const struct iio_chan_spec *channels, int num_channels)
+{
+	struct iio_dev *indio_dev;
+	unsigned long *masks;
+	int longs, ret;
+
+	if (!IS_REACHABLE(CONFIG_IIO_KFIFO_BUF) || !iio)
+		return NULL;
+
+	indio_dev = devm_iio_device_alloc(&hdev->dev, 0);
+	if (!indio_dev)
+		return NULL;
+
+	/* Zero-terminated list with a single mask of all channels but the timestamp */
+	longs = BITS_TO_LONGS(num_channels - 1);
+	masks = devm_kcalloc(&hdev->dev, 2 * longs, sizeof(*masks), GFP_KERNEL);
+	if (!masks)
+		return NULL;
+
+	bitmap_fill(masks, num_channels - 1);
+
+	indio_dev->name = name;
+	indio_dev->info = &nzxt_hid_iio_info;
+	indio_dev->channels = channels;
+	indio_dev->num_channels = num_channels;
+	indio_dev->available_scan_masks = masks;
+
+	ret = devm_iio_kfifo_buffer_setup(&hdev->dev, indio_dev, NULL);
+	if (ret)
+		goto fail;
+
+	ret = devm_iio_device_register(&hdev->dev, indio_dev);
+	if (ret)
+		goto fail;
+
+	return indio_dev;
+
+fail:
+	hid_warn(hdev, "IIO device registration failed with %d\n", ret);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_iio_register);
+
+/**
+ * nzxt_hid_iio_push() - Push a scan with the current time to the IIO buffer.
+ * @indio_dev:	IIO device from nzxt_hid_iio_register(); nothing is done if NULL.
+ * @scan:	Values of all channels, followed by room for an 8-byte aligned timestamp.
+ *
+ * Can be called from atomic context, such as the raw_event handlers.
+ */
+void nzxt_hid_iio_push(struct iio_dev *indio_dev, s32 *scan)
+{
+	if (!IS_REACHABLE(CONFIG_IIO_KFIFO_BUF) || !indio_dev)
+		return;
+
+	iio_push_to_buffers_with_timestamp(indio_dev, scan, iio_get_time_ns(indio_dev));
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_iio_push);
+
+static int nzxt_hid_get_max_state(struct thermal_cooling_device *cdev, unsigned long *state)
+{
+	*state = NZXT_HID_COOLING_STATES;
+	return 0;
+}
+
+static int nzxt_hid_get_cur_state(struct thermal_cooling_device *cdev, unsigned long *state)
+{
+	struct nzxt_hid_cooling *cooling = cdev->devdata;
+
+	*state = READ_ONCE(cooling->state);
+	return 0;
+}
+
+static int nzxt_hid_set_cur_state(struct thermal_cooling_device *cdev, unsigned long state)
+{
+	struct nzxt_hid_cooling *cooling = cdev->devdata;
+	int ret;
+
+	if (state > NZXT_HID_COOLING_STATES)
+		return -EINVAL;
+
+	ret = cooling->set_pwm(cooling->data, cooling->channel,
+			       DIV_ROUND_CLOSEST(state * 255, NZXT_HID_COOLING_STATES));
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(cooling->state, state);
+	return 0;
+}
+
+static const struct thermal_cooling_device_ops nzxt_hid_cooling_ops = {
+	.get_max_state = nzxt_hid_get_max_state,
+	.get_cur_state = nzxt_hid_get_cur_state,
+	.set_cur_state = nzxt_hid_set_cur_state,
+};
+
+/**
+ * nzxt_hid_cooling_register() - Register a channel as a thermal cooling device, if enabled.
+ * @hdev:	HID device, whose device tree node (if any) is used for the bindings.
+ * @cooling:	Cooling channel to fill in.
+ * @type:	Type of the cooling device, up to THERMAL_NAME_LENGTH.
+ * @set_pwm:	See &struct nzxt_hid_cooling.
+ * @data:	See &struct nzxt_hid_cooling.
+ * @channel:	See &struct nzxt_hid_cooling.
+ *
+ * Cooling states 0 to %NZXT_HID_COOLING_STATES map linearly onto duties of 0 to 100%. Failing
+ * to register isn't fatal for the drivers, so it's only logged. The cooling device must be
+ * unregistered with nzxt_hid_cooling_unregister() before whatever @set_pwm uses goes away.
+ */
+void nzxt_hid_cooling_register(struct hid_device *hdev, struct nzxt_hid_cooling *cooling,
+			       const char *type, int (*set_pwm)(void *data, int channel, long val),
+			       void *data, int channel)
+{
+	struct thermal_cooling_device *cdev;
+
+	cooling->cdev = NULL;
+	cooling->set_pwm = set_pwm;
+	cooling->data = data;
+	cooling->channel = channel;
+	cooling->state = 0;
+
+	if (!IS_REACHABLE(CONFIG_THERMAL) || !register_cooling)
+		return;
+
+	cdev = thermal_of_cooling_device_register(dev_of_node(&hdev->dev), type, cooling,
+						  &nzxt_hid_cooling_ops);
+	if (IS_ERR(cdev)) {
+		hid_warn(hdev, "cooling device registration failed with %ld\n", PTR_ERR(cdev));
+		return;
+	}
+
+	cooling->cdev = cdev;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_cooling_register);
+
+/**
+ * nzxt_hid_cooling_unregister() - Unregister a cooling device, if it was registered.
+ * @cooling:	Cooling channel from nzxt_hid_cooling_register().
+ *
+ * Once this returns, @cooling->set_pwm won't be called anymore.
+ */
+void nzxt_hid_cooling_unregister(struct nzxt_hid_cooling *cooling)
+{
+	if (!cooling->cdev)
+		return;
+
+	thermal_cooling_device_unregister(cooling->cdev);
+	cooling->cdev = NULL;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_cooling_unregister);
+
+/**
+ * nzxt_hid_validity() - Get the validity period of a staleness policy.
+ * @staleness:	Staleness policy.
+ *
+ * Return: the validity period, in jiffies.
+ */
+unsigned long nzxt_hid_validity(const struct nzxt_hid_staleness *staleness)
+{
+	return msecs_to_jiffies(min_t(u32, READ_ONCE(staleness->validity_ms),
+				      NZXT_HID_STALE_MAX_MS));
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_validity);
+
+/**
+ * nzxt_hid_is_stale() - Check whether data is past its validity period.
+ * @staleness:	Staleness policy.
+ * @updated:	When the data was received, in jiffies.
+ *
+ * Return: whether the data should be refreshed, if the device allows it.
+ */
+bool nzxt_hid_is_stale(const struct nzxt_hid_staleness *staleness, unsigned long updated)
+{
+	return time_after(jiffies, updated + nzxt_hid_validity(staleness));
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_is_stale);
+
+/**
+ * nzxt_hid_is_expired() - Check whether data is past its validity and grace periods.
+ * @staleness:	Staleness policy.
+ * @updated:	When the data was received, in jiffies.
+ *
+ * Return: whether the data shouldn't be served anymore.
+ */
+bool nzxt_hid_is_expired(const struct nzxt_hid_staleness *staleness, unsigned long updated)
+{
+	u32 grace_ms = min_t(u32, READ_ONCE(staleness->grace_ms), NZXT_HID_STALE_MAX_MS);
+
+	return time_after(jiffies, updated + nzxt_hid_validity(staleness) +
+			  msecs_to_jiffies(grace_ms));
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_is_expired);
+
+/**
+ * nzxt_hid_never_updated() - Get an update time for data that was never received.
+ *
+ * Return: a time far enough in the past for the data to be expired under any policy, in jiffies.
+ */
+unsigned long nzxt_hid_never_updated(void)
+{
+	return jiffies - 2 * msecs_to_jiffies(NZXT_HID_STALE_MAX_MS) - 1;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_never_updated);
+
+/**
+ * nzxt_hid_staleness_debugfs() - Create the debugfs files of a staleness policy.
+ * @dir:	Debugfs directory of the device.
+ * @staleness:	Staleness policy.
+ */
+void nzxt_hid_staleness_debugfs(struct dentry *dir, struct nzxt_hid_staleness *staleness)
+{
+	debugfs_create_u32("validity_ms", 0644, dir, &staleness->validity_ms);
+	debugfs_create_u32("grace_ms", 0644, dir, &staleness->grace_ms);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_staleness_debugfs);
+
+/**
+ * nzxt_hid_show_age() - Show the age of data in a seq_file.
+ * @seqf:	seq_file, usually of a debugfs file.
+ * @name:	Name of the data, such as the hwmon attribute prefix of a channel.
+ * @updated:	When the data was received, in jiffies.
+ */
+void nzxt_hid_show_age(struct seq_file *seqf, const char *name, unsigned long updated)
+{
+	seq_printf(seqf, "%s: %u\n", name, jiffies_to_msecs(jiffies - updated));
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_show_age);
+
+static void nzxt_hid_notify_work(struct work_struct *work)
+{
+	struct nzxt_hid_notify *notify = container_of(work, struct nzxt_hid_notify, work);
+	struct kobject *kobj;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&notify->lock, flags);
+	kobj = notify->kobj;
+	spin_unlock_irqrestore(&notify->lock, flags);
+
+	/* Stopping waits for this work, so the kobject can't go away in the meantime */
+	if (!kobj)
+		return;
+
+	for (i = 0; notify->attrs[i]; i++)
+		sysfs_notify(kobj, NULL, notify->attrs[i]);
+}
+
+/**
+ * nzxt_hid_notify_init() - Initialize a deferred notification, stopped.
+ * @notify:	Notification to initialize.
+ * @attrs:	NULL-terminated names of the attributes to notify.
+ */
+void nzxt_hid_notify_init(struct nzxt_hid_notify *notify, const char *const *attrs)
+{
+	spin_lock_init(&notify->lock);
+	notify->kobj = NULL;
+	notify->attrs = attrs;
+	INIT_WORK(&notify->work, nzxt_hid_notify_work);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_notify_init);
+
+/**
+ * nzxt_hid_notify_start() - Start notifying the attributes of a device.
+ * @notify:	Notification from nzxt_hid_notify_init().
+ * @dev:	Device with the attributes, usually the hwmon device.
+ */
+void nzxt_hid_notify_start(struct nzxt_hid_notify *notify, struct device *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&notify->lock, flags);
+	notify->kobj = &dev->kobj;
+	spin_unlock_irqrestore(&notify->lock, flags);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_notify_start);
+
+/**
+ * nzxt_hid_notify_stop() - Stop notifying, and wait for a notification in progress.
+ * @notify:	Notification from nzxt_hid_notify_init().
+ *
+ * Must be called before the device passed to nzxt_hid_notify_start() goes away.
+ */
+void nzxt_hid_notify_stop(struct nzxt_hid_notify *notify)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&notify->lock, flags);
+	notify->kobj = NULL;
+	spin_unlock_irqrestore(&notify->lock, flags);
+
+	cancel_work_sync(&notify->work);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_notify_stop);
+
+/**
+ * nzxt_hid_notify() - Notify pollers of the attributes, from process context.
+ * @notify:	Notification from nzxt_hid_notify_init().
+ *
+ * Can be called from any context, such as the raw_event handlers. Nothing is done while
+ * stopped, and calls coming in before the work runs are notified once.
+ */
+void nzxt_hid_notify(struct nzxt_hid_notify *notify)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&notify->lock, flags);
+	if (notify->kobj)
+		schedule_work(&notify->work);
+	spin_unlock_irqrestore(&notify->lock, flags);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_notify);
+
+/*
+ * Encoding of the status report interval byte, shared by the RGB & Fan Controller (nzxt-smart2)
+ * and the Kraken X53/Z53/2023 (nzxt-kraken3, byte 4 of the 0x70 0x02 init command). Every step
+ * is nominally 250ms, starting from 0.5s at 0x01: liquidctl's Kraken X3/Z3 driver computes the
+ * byte as 1 + round((seconds - 0.5) / 0.25). Measured on the RGB & Fan Controller:
+ *
+ * Control byte	| Actual update interval in seconds
+ * 0xff		| 65.5
+ * 0xf7		| 63.46
+ * 0x7f		| 32.74
+ * 0x3f		| 16.36
+ * 0x1f		| 8.17
+ * 0x0f		| 4.07
+ * 0x07		| 2.02
+ * 0x03		| 1.00
+ * 0x02		| 0.744
+ * 0x01		| 0.488
+ * 0x00		| 0.25
+ *
+ * The helpers below follow the measurements, which stay within a few ms per step of the nominal
+ * encoding.
+ */
+
+/**
+ * nzxt_hid_interval_to_byte() - Encode a status report interval.
+ * @interval:	Interval, in ms.
+ *
+ * Return: the control byte of the closest interval the devices support.
+ */
+u8 nzxt_hid_interval_to_byte(long interval)
+{
+	if (interval <= 250)
+		return 0;
+
+	return clamp_val(1 + DIV_ROUND_CLOSEST(interval - 488, 256), 0, 255);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_interval_to_byte);
+
+/**
+ * nzxt_hid_byte_to_interval() - Decode a status report interval.
+ * @control_byte: Control byte, as sent to the device.
+ *
+ * Return: the interval, in ms.
+ */
+long nzxt_hid_byte_to_interval(u8 control_byte)
+{
+	if (control_byte == 0)
+		return 250;
+
+	return 488 + (control_byte - 1) * 256;
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_byte_to_interval);
+
+/**
+ * nzxt_hid_hist_add() - Account for a duration in a log2 histogram.
+ * @hist:	Histogram of NZXT_HID_HIST_BUCKETS buckets.
+ * @us:		Duration, in us.
+ */
+void nzxt_hid_hist_add(atomic_long_t *hist, s64 us)
+{
+	int bucket = us > 0 ? min(fls64(us), NZXT_HID_HIST_BUCKETS - 1) : 0;
+
+	atomic_long_inc(&hist[bucket]);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_hist_add);
+
+/**
+ * nzxt_hid_show_hist() - Show a log2 histogram in a seq_file.
+ * @seqf:	seq_file, usually of a debugfs file.
+ * @name:	Name of the histogram.
+ * @hist:	Histogram of NZXT_HID_HIST_BUCKETS buckets.
+ */
+void nzxt_hid_show_hist(struct seq_file *seqf, const char *name, atomic_long_t *hist)
+{
+	int i;
+
+	seq_printf(seqf, "%s:\n", name);
+	seq_printf(seqf, "  %10s: %lu\n", "<1", atomic_long_read(&hist[0]));
+
+	for (i = 1; i < NZXT_HID_HIST_BUCKETS - 1; i++)
+		seq_printf(seqf, "  %4lu-%-5lu: %lu\n", 1UL << (i - 1), (1UL << i) - 1,
+			   atomic_long_read(&hist[i]));
+
+	seq_printf(seqf, "  >=%-8lu: %lu\n", 1UL << (i - 1), atomic_long_read(&hist[i]));
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_show_hist);
+
+/**
+ * nzxt_hid_show_stats() - Show the statistics of an output report path in a seq_file.
+ * @seqf:	seq_file, usually of a debugfs file.
+ * @out:	Output report path.
+ */
+void nzxt_hid_show_stats(struct seq_file *seqf, struct nzxt_hid_out *out)
+{
+	struct nzxt_hid_stats *stats = &out->stats;
+
+	seq_printf(seqf, "reports_sent: %lu\n", atomic_long_read(&stats->reports_sent));
+	seq_printf(seqf, "send_errors: %lu\n", atomic_long_read(&stats->send_errors));
+	seq_printf(seqf, "timeouts: %lu\n", atomic_long_read(&stats->timeouts));
+	seq_printf(seqf, "interrupted: %lu\n", atomic_long_read(&stats->interrupted));
+
+	nzxt_hid_show_hist(seqf, "lock_wait_us", stats->lock_wait);
+	nzxt_hid_show_hist(seqf, "send_time_us", stats->send_time);
+}
+EXPORT_SYMBOL_GPL(nzxt_hid_show_stats);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Common output report handling for NZXT HID hwmon drivers");
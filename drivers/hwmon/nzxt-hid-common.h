@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Output report handling shared by the NZXT HID hwmon drivers.
+ */
+
+#ifndef _NZXT_HID_COMMON_H
+#define _NZXT_HID_COMMON_H
+
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/hid.h>
+#include <linux/iio/iio.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/thermal.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+#define NZXT_HID_HIST_BUCKETS	24	/* Powers of two of us, last one is up to the timeouts */
+#define NZXT_HID_COOLING_STATES	10	/* Cooling states above 0, in duty steps of 10% */
+#define NZXT_HID_STALE_MAX_MS	300000	/* Upper bound of both the validity and the grace period */
+
+/**
+ * struct nzxt_hid_stats - Output and reply statistics of a device.
+ * @reports_sent:	Output reports sent successfully.
+ * @send_errors:	Output reports that failed to be sent.
+ * @timeouts:		Replies that didn't arrive in time.
+ * @interrupted:	Waits for replies that were interrupted.
+ * @lock_wait:		log2 histogram of the time spent waiting for the output buffer, in us.
+ * @send_time:		log2 histogram of the time spent sending reports, in us.
+ */
+struct nzxt_hid_stats {
+	atomic_long_t reports_sent;
+	atomic_long_t send_errors;
+	atomic_long_t timeouts;
+	atomic_long_t interrupted;
+	atomic_long_t lock_wait[NZXT_HID_HIST_BUCKETS];
+	atomic_long_t send_time[NZXT_HID_HIST_BUCKETS];
+};
+
+/**
+ * struct nzxt_hid_out - Output report path of a device.
+ * @hdev:	HID device.
+ * @lock:	Serializes the use of @buf, and of the device for output reports.
+ * @buf:	DMA-safe buffer for the reports.
+ * @size:	Size of @buf, and of every report if @pad is set.
+ * @pad:	Whether shorter reports are zero-padded to @size.
+ * @stats:	Statistics.
+ */
+struct nzxt_hid_out {
+	struct hid_device *hdev;
+
+	struct mutex lock; /* see comment above */
+	u8 *buf;
+	size_t size;
+	bool pad;
+
+	struct nzxt_hid_stats stats;
+};
+
+int nzxt_hid_out_init(struct nzxt_hid_out *out, struct hid_device *hdev, size_t size, bool pad);
+
+int nzxt_hid_send(struct nzxt_hid_out *out, const void *data, size_t len);
+
+int nzxt_hid_wait_for_reply(struct nzxt_hid_out *out, struct completion *done,
+			    unsigned long timeout);
+
+/*
+ * A 32-bit, CPU-endian IIO channel that is only available through the buffer. Values are in the
+ * units of the hwmon ABI, with fan speeds (IIO_ANGL_VEL) in rpm.
+ */
+#define NZXT_HID_IIO_CHAN(_type, _channel, _index) {			\
+	.type = (_type),						\
+	.indexed = 1,							\
+	.channel = (_channel),						\
+	.scan_index = (_index),						\
+	.scan_type = {							\
+		.sign = 's',						\
+		.realbits = 32,						\
+		.storagebits = 32,					\
+		.endianness = IIO_CPU,					\
+	},								\
+}
+
+struct iio_dev *nzxt_hid_iio_register(struct hid_device *hdev, const char *name,
+				      const struct iio_chan_spec *channels, int num_channels);
+void nzxt_hid_iio_push(struct iio_dev *indio_dev, s32 *scan);
+
+/**
+ * struct nzxt_hid_cooling - Channel registered as a thermal cooling device.
+ * @cdev:	Cooling device, or NULL if not registered.
+ * @set_pwm:	Sets the duty of @channel as writing its pwm attribute would, in PWM (0-255).
+ *		Called in process context, and may sleep.
+ * @data:	First argument of @set_pwm.
+ * @channel:	Channel of the device, from 0.
+ * @state:	Last cooling state that was set successfully.
+ */
+struct nzxt_hid_cooling {
+	struct thermal_cooling_device *cdev;
+	int (*set_pwm)(void *data, int channel, long val);
+	void *data;
+	int channel;
+	unsigned long state;
+};
+
+void nzxt_hid_cooling_register(struct hid_device *hdev, struct nzxt_hid_cooling *cooling,
+			       const char *type, int (*set_pwm)(void *data, int channel, long val),
+			       void *data, int channel);
+void nzxt_hid_cooling_unregister(struct nzxt_hid_cooling *cooling);
+
+/**
+ * struct nzxt_hid_staleness - How long decoded status data is served for.
+ * @validity_ms: Age up to which data is current.
+ * @grace_ms:	Further age up to which data that can't be refreshed is still served, instead of
+ *		an error.
+ *
+ * Both can be changed through debugfs, and are clamped to %NZXT_HID_STALE_MAX_MS when used.
+ */
+struct nzxt_hid_staleness {
+	u32 validity_ms;
+	u32 grace_ms;
+};
+
+unsigned long nzxt_hid_validity(const struct nzxt_hid_staleness *staleness);
+bool nzxt_hid_is_stale(const struct nzxt_hid_staleness *staleness, unsigned long updated);
+bool nzxt_hid_is_expired(const struct nzxt_hid_staleness *staleness, unsigned long updated);
+unsigned long nzxt_hid_never_updated(void);
+void nzxt_hid_staleness_debugfs(struct dentry *dir, struct nzxt_hid_staleness *staleness);
+void nzxt_hid_show_age(struct seq_file *seqf, const char *name, unsigned long updated);
+
+/**
+ * struct nzxt_hid_notify - Deferred sysfs_notify() of attributes, for input report handlers.
+ * @lock:	Protects @kobj.
+ * @kobj:	Kobject whose attributes are notified, or NULL while stopped.
+ * @attrs:	NULL-terminated names of the attributes.
+ * @work:	Does the notifying, as sysfs_notify() can sleep.
+ */
+struct nzxt_hid_notify {
+	spinlock_t lock; /* see comment above */
+	struct kobject *kobj;
+	const char *const *attrs;
+	struct work_struct work;
+};
+
+void nzxt_hid_notify_init(struct nzxt_hid_notify *notify, const char *const *attrs);
+void nzxt_hid_notify_start(struct nzxt_hid_notify *notify, struct device *dev);
+void nzxt_hid_notify_stop(struct nzxt_hid_notify *notify);
+void nzxt_hid_notify(struct nzxt_hid_notify *notify);
+
+u8 nzxt_hid_interval_to_byte(long interval);
+long nzxt_hid_byte_to_interval(u8 control_byte);
+
+void nzxt_hid_hist_add(atomic_long_t *hist, s64 us);
+void nzxt_hid_show_hist(struct seq_file *seqf, const char *name, atomic_long_t *hist);
+void nzxt_hid_show_stats(struct seq_file *seqf, struct nzxt_hid_out *out);
+
+#endif /* _NZXT_HID_COMMON_H */
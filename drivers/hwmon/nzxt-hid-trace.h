@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints for the NZXT HID hwmon drivers.
+ *
+ * The events are defined in nzxt-hid-common and exported to the drivers. When
+ * disabled, each one costs a static branch.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nzxt_hid
+
+#if !defined(_NZXT_HID_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _NZXT_HID_TRACE_H
+
+#include <linux/hid.h>
+#include <linux/string.h>
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+#ifndef _NZXT_HID_TRACE_SENSORS
+#define _NZXT_HID_TRACE_SENSORS
+
+/* Kinds of values decoded from input reports, in the units of the hwmon ABI except for duty */
+enum nzxt_hid_sensor {
+	NZXT_HID_TEMP,	/* millidegrees Celsius */
+	NZXT_HID_FAN,	/* rpm */
+	NZXT_HID_DUTY,	/* percent, as reported by the devices */
+	NZXT_HID_IN,	/* millivolts */
+	NZXT_HID_CURR,	/* milliamperes */
+};
+
+#endif /* _NZXT_HID_TRACE_SENSORS */
+
+TRACE_DEFINE_ENUM(NZXT_HID_TEMP);
+TRACE_DEFINE_ENUM(NZXT_HID_FAN);
+TRACE_DEFINE_ENUM(NZXT_HID_DUTY);
+TRACE_DEFINE_ENUM(NZXT_HID_IN);
+TRACE_DEFINE_ENUM(NZXT_HID_CURR);
+
+#define NZXT_HID_DEV_LEN	32
+
+TRACE_EVENT(nzxt_hid_raw_event,
+	TP_PROTO(struct hid_device *hdev, u8 report_id, int size),
+	TP_ARGS(hdev, report_id, size),
+
+	TP_STRUCT__entry(
+		__array(char, dev, NZXT_HID_DEV_LEN)
+		__field(u8, report_id)
+		__field(int, size)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(&hdev->dev), NZXT_HID_DEV_LEN);
+		__entry->report_id = report_id;
+		__entry->size = size;
+	),
+
+	TP_printk("%s report_id=0x%02x size=%d", __entry->dev, __entry->report_id,
+		  __entry->size)
+);
+
+TRACE_EVENT(nzxt_hid_sensor,
+	TP_PROTO(struct hid_device *hdev, enum nzxt_hid_sensor sensor, int channel, long value),
+	TP_ARGS(hdev, sensor, channel, value),
+
+	TP_STRUCT__entry(
+		__array(char, dev, NZXT_HID_DEV_LEN)
+		__field(int, sensor)
+		__field(int, channel)
+		__field(long, value)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(&hdev->dev), NZXT_HID_DEV_LEN);
+		__entry->sensor = sensor;
+		__entry->channel = channel;
+		__entry->value = value;
+	),
+
+	/* Named like the hwmon attributes, with channels starting from 1 */
+	TP_printk("%s %s%d=%ld", __entry->dev,
+		  __print_symbolic(__entry->sensor,
+				   { NZXT_HID_TEMP, "temp" },
+				   { NZXT_HID_FAN, "fan" },
+				   { NZXT_HID_DUTY, "duty" },
+				   { NZXT_HID_IN, "in" },
+				   { NZXT_HID_CURR, "curr" }),
+		  __entry->channel + 1, __entry->value)
+);
+
+TRACE_EVENT(nzxt_hid_output_report,
+	TP_PROTO(struct hid_device *hdev, const u8 *data, size_t len, int ret, s64 duration_us),
+	TP_ARGS(hdev, data, len, ret, duration_us),
+
+	TP_STRUCT__entry(
+		__array(char, dev, NZXT_HID_DEV_LEN)
+		__field(u8, report_id)
+		__field(u8, command)
+		__field(size_t, len)
+		__field(int, ret)
+		__field(s64, duration_us)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(&hdev->dev), NZXT_HID_DEV_LEN);
+		__entry->report_id = data[0];
+		__entry->command = len > 1 ? data[1] : 0;
+		__entry->len = len;
+		__entry->ret = ret;
+		__entry->duration_us = duration_us;
+	),
+
+	TP_printk("%s report_id=0x%02x command=0x%02x len=%zu ret=%d duration_us=%lld",
+		  __entry->dev, __entry->report_id, __entry->command, __entry->len,
+		  __entry->ret, __entry->duration_us)
+);
+
+TRACE_EVENT(nzxt_hid_status_request,
+	TP_PROTO(struct hid_device *hdev),
+	TP_ARGS(hdev),
+
+	TP_STRUCT__entry(
+		__array(char, dev, NZXT_HID_DEV_LEN)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(&hdev->dev), NZXT_HID_DEV_LEN);
+	),
+
+	TP_printk("%s", __entry->dev)
+);
+
+TRACE_EVENT(nzxt_hid_status_complete,
+	TP_PROTO(struct hid_device *hdev, int ret, s64 latency_us),
+	TP_ARGS(hdev, ret, latency_us),
+
+	TP_STRUCT__entry(
+		__array(char, dev, NZXT_HID_DEV_LEN)
+		__field(int, ret)
+		__field(s64, latency_us)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(&hdev->dev), NZXT_HID_DEV_LEN);
+		__entry->ret = ret;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk("%s ret=%d latency_us=%lld", __entry->dev, __entry->ret, __entry->latency_us)
+);
+
+#endif /* _NZXT_HID_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nzxt-hid-trace
+#include <trace/define_trace.h>
@@ -17,13 +17,22 @@
 #include <asm/unaligned.h>
 #endif
 
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
 #include <linux/hid.h>
 #include <linux/hwmon.h>
+#include <linux/hwmon-sysfs.h>
 #include <linux/jiffies.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include "nzxt-hid-common.h"
+#include "nzxt-hid-trace.h"
 
 #define STATUS_REPORT_ID	0x04
-#define STATUS_VALIDITY		2 /* seconds; equivalent to 4 missed updates */
+#define STATUS_VALIDITY		2 /* default, in seconds; equivalent to 4 missed updates */
 
 static const char *const kraken2_temp_label[] = {
 	"Coolant",
@@ -34,18 +43,275 @@ static const char *const kraken2_fan_label[] = {
 	"Pump",
 };
 
+/* Coolant temperature, then fan and pump speeds, as in the status reports */
+static const struct iio_chan_spec kraken2_iio_channels[] = {
+	NZXT_HID_IIO_CHAN(IIO_TEMP, 0, 0),
+	NZXT_HID_IIO_CHAN(IIO_ANGL_VEL, 0, 1),
+	NZXT_HID_IIO_CHAN(IIO_ANGL_VEL, 1, 2),
+	IIO_CHAN_SOFT_TIMESTAMP(3),
+};
+
+/* Bits of kraken2_priv_data.alarms */
+#define ALARM_TEMP_MAX	0
+#define ALARM_TEMP_CRIT	1
+#define ALARM_FAN_MIN	2 /* fan1 and fan2 */
+#define ALARM_STALE	4 /* reported as temp1_fault and fan[1-2]_fault */
+
+/* Indexes into kraken2_priv_data.history */
+#define HISTORY_TEMP	0 /* temp1 */
+#define HISTORY_FAN	1 /* fan1 and fan2 */
+#define HISTORY_COUNT	3
+
+/* Values kept in a kraken2_history, as selected by kraken2_read_history() */
+enum kraken2_history_value {
+	HIST_LOWEST,
+	HIST_HIGHEST,
+	HIST_AVERAGE,
+};
+
+/*
+ * Lowest, highest and average values of a sensor since the history was last
+ * reset.  Meaningless while count is zero.
+ */
+struct kraken2_history {
+	long lowest;
+	long highest;
+	s64 sum;
+	u32 count;
+};
+
 struct kraken2_priv_data {
 	struct hid_device *hid_dev;
 	struct device *hwmon_dev;
+	struct iio_dev *iio_dev; /* optional */
+	struct dentry *debugfs;
 	s32 temp_input[1];
 	u16 fan_input[2];
 	unsigned long updated; /* jiffies */
+	struct nzxt_hid_staleness staleness;
+
+	spinlock_t history_lock; /* protects history */
+	struct kraken2_history history[HISTORY_COUNT];
+
+	/*
+	 * Limits (0 to disable) and alarms, checked as each report arrives.
+	 * Changed alarms are notified from alarm_work, as hwmon_notify_event()
+	 * can't be called from raw_event; stale_work raises ALARM_STALE once
+	 * reports stop.  Works are only queued while alarms_enabled.
+	 */
+	spinlock_t alarm_lock; /* protects the members below */
+	long temp_max;
+	long temp_crit;
+	long fan_min[2];
+	unsigned long alarms;
+	unsigned long alarms_changed;
+	bool alarms_enabled;
+	struct work_struct alarm_work;
+	struct delayed_work stale_work;
 };
 
+static void kraken2_history_add(struct kraken2_history *history, long val)
+{
+	if (!history->count || val < history->lowest)
+		history->lowest = val;
+	if (!history->count || val > history->highest)
+		history->highest = val;
+
+	history->sum += val;
+	history->count++;
+}
+
+static void kraken2_reset_history(struct kraken2_priv_data *priv, int first, int count)
+{
+	int i;
+
+	spin_lock_bh(&priv->history_lock);
+	for (i = first; i < first + count; i++)
+		priv->history[i].count = 0;
+	spin_unlock_bh(&priv->history_lock);
+}
+
+/* Reads the lowest, highest or average value of a sensor */
+static int kraken2_read_history(struct kraken2_priv_data *priv, int index,
+				enum kraken2_history_value which, long *val)
+{
+	struct kraken2_history *history = &priv->history[index];
+	int ret = 0;
+
+	spin_lock_bh(&priv->history_lock);
+
+	if (!history->count) {
+		ret = -ENODATA;
+		goto unlock;
+	}
+
+	switch (which) {
+	case HIST_LOWEST:
+		*val = history->lowest;
+		break;
+	case HIST_HIGHEST:
+		*val = history->highest;
+		break;
+	case HIST_AVERAGE:
+		*val = div_s64(history->sum, history->count);
+		break;
+	}
+
+unlock:
+	spin_unlock_bh(&priv->history_lock);
+	return ret;
+}
+
+/* Caller must hold priv->alarm_lock */
+static void kraken2_set_alarm(struct kraken2_priv_data *priv, int bit, bool alarm)
+{
+	if (alarm == test_bit(bit, &priv->alarms))
+		return;
+
+	if (alarm)
+		__set_bit(bit, &priv->alarms);
+	else
+		__clear_bit(bit, &priv->alarms);
+
+	__set_bit(bit, &priv->alarms_changed);
+	if (priv->alarms_enabled)
+		schedule_work(&priv->alarm_work);
+}
+
+/* Caller must hold priv->alarm_lock */
+static void kraken2_check_alarms(struct kraken2_priv_data *priv)
+{
+	long temp = priv->temp_input[0];
+	int i;
+
+	kraken2_set_alarm(priv, ALARM_TEMP_MAX, priv->temp_max && temp >= priv->temp_max);
+	kraken2_set_alarm(priv, ALARM_TEMP_CRIT, priv->temp_crit && temp >= priv->temp_crit);
+
+	for (i = 0; i < ARRAY_SIZE(priv->fan_min); i++)
+		kraken2_set_alarm(priv, ALARM_FAN_MIN + i,
+				  priv->fan_min[i] && priv->fan_input[i] < priv->fan_min[i]);
+
+	kraken2_set_alarm(priv, ALARM_STALE, false);
+}
+
+static void kraken2_alarm_work(struct work_struct *work)
+{
+	struct kraken2_priv_data *priv = container_of(work, struct kraken2_priv_data, alarm_work);
+	unsigned long changed;
+	int i;
+
+	spin_lock_bh(&priv->alarm_lock);
+	changed = priv->alarms_changed;
+	priv->alarms_changed = 0;
+	spin_unlock_bh(&priv->alarm_lock);
+
+	if (test_bit(ALARM_TEMP_MAX, &changed))
+		hwmon_notify_event(priv->hwmon_dev, hwmon_temp, hwmon_temp_max_alarm, 0);
+	if (test_bit(ALARM_TEMP_CRIT, &changed))
+		hwmon_notify_event(priv->hwmon_dev, hwmon_temp, hwmon_temp_crit_alarm, 0);
+
+	for (i = 0; i < ARRAY_SIZE(priv->fan_min); i++) {
+		if (test_bit(ALARM_FAN_MIN + i, &changed))
+			hwmon_notify_event(priv->hwmon_dev, hwmon_fan, hwmon_fan_min_alarm, i);
+	}
+
+	if (test_bit(ALARM_STALE, &changed)) {
+		hwmon_notify_event(priv->hwmon_dev, hwmon_temp, hwmon_temp_fault, 0);
+		for (i = 0; i < ARRAY_SIZE(priv->fan_input); i++)
+			hwmon_notify_event(priv->hwmon_dev, hwmon_fan, hwmon_fan_fault, i);
+	}
+}
+
+/* Rearmed by every report, so this only runs once they stop */
+static void kraken2_stale_work(struct work_struct *work)
+{
+	struct kraken2_priv_data *priv = container_of(work, struct kraken2_priv_data,
+						      stale_work.work);
+
+	spin_lock_bh(&priv->alarm_lock);
+	kraken2_set_alarm(priv, ALARM_STALE, true);
+	spin_unlock_bh(&priv->alarm_lock);
+}
+
+static int kraken2_read_alarm(struct kraken2_priv_data *priv, enum hwmon_sensor_types type,
+			      u32 attr, int channel, long *val)
+{
+	int ret = 0;
+
+	spin_lock_bh(&priv->alarm_lock);
+
+	switch (type) {
+	case hwmon_temp:
+		switch (attr) {
+		case hwmon_temp_max:
+			*val = priv->temp_max;
+			break;
+		case hwmon_temp_crit:
+			*val = priv->temp_crit;
+			break;
+		case hwmon_temp_max_alarm:
+			*val = test_bit(ALARM_TEMP_MAX, &priv->alarms);
+			break;
+		case hwmon_temp_crit_alarm:
+			*val = test_bit(ALARM_TEMP_CRIT, &priv->alarms);
+			break;
+		case hwmon_temp_fault:
+			*val = test_bit(ALARM_STALE, &priv->alarms);
+			break;
+		default:
+			ret = -EOPNOTSUPP;
+			break;
+		}
+		break;
+	case hwmon_fan:
+		switch (attr) {
+		case hwmon_fan_min:
+			*val = priv->fan_min[channel];
+			break;
+		case hwmon_fan_min_alarm:
+			*val = test_bit(ALARM_FAN_MIN + channel, &priv->alarms);
+			break;
+		case hwmon_fan_fault:
+			*val = test_bit(ALARM_STALE, &priv->alarms);
+			break;
+		default:
+			ret = -EOPNOTSUPP;
+			break;
+		}
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+
+	spin_unlock_bh(&priv->alarm_lock);
+	return ret;
+}
+
 static umode_t kraken2_is_visible(const void *data,
 				  enum hwmon_sensor_types type,
 				  u32 attr, int channel)
 {
+	switch (type) {
+	case hwmon_temp:
+		switch (attr) {
+		case hwmon_temp_reset_history:
+			return 0200;
+		case hwmon_temp_max:
+		case hwmon_temp_crit:
+			return 0644;
+		default:
+			break;
+		}
+		break;
+	case hwmon_fan:
+		if (attr == hwmon_fan_min)
+			return 0644;
+		break;
+	default:
+		break;
+	}
+
 	return 0444;
 }
 
@@ -54,7 +320,17 @@ static int kraken2_read(struct device *dev, enum hwmon_sensor_types type,
 {
 	struct kraken2_priv_data *priv = dev_get_drvdata(dev);
 
-	if (time_after(jiffies, priv->updated + STATUS_VALIDITY * HZ))
+	/* The history, limits and alarms stay valid even if the device stops sending reports */
+	if (type == hwmon_temp && attr == hwmon_temp_lowest)
+		return kraken2_read_history(priv, HISTORY_TEMP, HIST_LOWEST, val);
+	if (type == hwmon_temp && attr == hwmon_temp_highest)
+		return kraken2_read_history(priv, HISTORY_TEMP, HIST_HIGHEST, val);
+
+	if ((type == hwmon_temp && attr != hwmon_temp_input) ||
+	    (type == hwmon_fan && attr != hwmon_fan_input))
+		return kraken2_read_alarm(priv, type, attr, channel, val);
+
+	if (nzxt_hid_is_expired(&priv->staleness, priv->updated))
 		return -ENODATA;
 
 	switch (type) {
@@ -87,18 +363,122 @@ static int kraken2_read_string(struct device *dev, enum hwmon_sensor_types type,
 	return 0;
 }
 
+static int kraken2_write(struct device *dev, enum hwmon_sensor_types type,
+			 u32 attr, int channel, long val)
+{
+	struct kraken2_priv_data *priv = dev_get_drvdata(dev);
+
+	switch (type) {
+	case hwmon_temp:
+		switch (attr) {
+		case hwmon_temp_reset_history:
+			kraken2_reset_history(priv, HISTORY_TEMP, 1);
+			return 0;
+		case hwmon_temp_max:
+		case hwmon_temp_crit:
+			/* The coolant is liquid water, after all */
+			val = clamp_val(val, 0, 100000);
+
+			spin_lock_bh(&priv->alarm_lock);
+			if (attr == hwmon_temp_max)
+				priv->temp_max = val;
+			else
+				priv->temp_crit = val;
+			spin_unlock_bh(&priv->alarm_lock);
+			return 0;
+		default:
+			break;
+		}
+		break;
+	case hwmon_fan:
+		if (attr != hwmon_fan_min)
+			break;
+
+		spin_lock_bh(&priv->alarm_lock);
+		priv->fan_min[channel] = clamp_val(val, 0, U16_MAX);
+		spin_unlock_bh(&priv->alarm_lock);
+		return 0;
+	default:
+		break;
+	}
+
+	return -EOPNOTSUPP; /* unreachable */
+}
+
 static const struct hwmon_ops kraken2_hwmon_ops = {
 	.is_visible = kraken2_is_visible,
 	.read = kraken2_read,
 	.read_string = kraken2_read_string,
+	.write = kraken2_write,
 };
 
+/*
+ * The hwmon core has no average attribute for temperatures, nor any history
+ * attributes for fans, so these are custom.  Attributes are indexed by their
+ * sensor in kraken2_priv_data.history.
+ */
+static ssize_t kraken2_history_show(struct device *dev, struct device_attribute *attr,
+				    char *buf)
+{
+	struct sensor_device_attribute_2 *sattr = to_sensor_dev_attr_2(attr);
+	struct kraken2_priv_data *priv = dev_get_drvdata(dev);
+	long val;
+	int ret;
+
+	ret = kraken2_read_history(priv, sattr->index, sattr->nr, &val);
+	if (ret)
+		return ret;
+
+	return sysfs_emit(buf, "%ld\n", val);
+}
+
+static ssize_t kraken2_reset_history_store(struct device *dev, struct device_attribute *attr,
+					   const char *buf, size_t count)
+{
+	struct sensor_device_attribute_2 *sattr = to_sensor_dev_attr_2(attr);
+	struct kraken2_priv_data *priv = dev_get_drvdata(dev);
+
+	/* nr is the number of histories to reset, starting at index */
+	kraken2_reset_history(priv, sattr->index, sattr->nr);
+	return count;
+}
+
+static SENSOR_DEVICE_ATTR_2_RO(temp1_average, kraken2_history, HIST_AVERAGE, HISTORY_TEMP);
+static SENSOR_DEVICE_ATTR_2_RO(fan1_lowest, kraken2_history, HIST_LOWEST, HISTORY_FAN);
+static SENSOR_DEVICE_ATTR_2_RO(fan1_highest, kraken2_history, HIST_HIGHEST, HISTORY_FAN);
+static SENSOR_DEVICE_ATTR_2_RO(fan1_average, kraken2_history, HIST_AVERAGE, HISTORY_FAN);
+static SENSOR_DEVICE_ATTR_2_WO(fan1_reset_history, kraken2_reset_history, 1, HISTORY_FAN);
+static SENSOR_DEVICE_ATTR_2_RO(fan2_lowest, kraken2_history, HIST_LOWEST, HISTORY_FAN + 1);
+static SENSOR_DEVICE_ATTR_2_RO(fan2_highest, kraken2_history, HIST_HIGHEST, HISTORY_FAN + 1);
+static SENSOR_DEVICE_ATTR_2_RO(fan2_average, kraken2_history, HIST_AVERAGE, HISTORY_FAN + 1);
+static SENSOR_DEVICE_ATTR_2_WO(fan2_reset_history, kraken2_reset_history, 1, HISTORY_FAN + 1);
+
+static struct attribute *kraken2_history_attrs[] = {
+	&sensor_dev_attr_temp1_average.dev_attr.attr,
+	&sensor_dev_attr_fan1_lowest.dev_attr.attr,
+	&sensor_dev_attr_fan1_highest.dev_attr.attr,
+	&sensor_dev_attr_fan1_average.dev_attr.attr,
+	&sensor_dev_attr_fan1_reset_history.dev_attr.attr,
+	&sensor_dev_attr_fan2_lowest.dev_attr.attr,
+	&sensor_dev_attr_fan2_highest.dev_attr.attr,
+	&sensor_dev_attr_fan2_average.dev_attr.attr,
+	&sensor_dev_attr_fan2_reset_history.dev_attr.attr,
+	NULL
+};
+
+ATTRIBUTE_GROUPS(kraken2_history);
+
 static const struct hwmon_channel_info *kraken2_info[] = {
 	HWMON_CHANNEL_INFO(temp,
-			   HWMON_T_INPUT | HWMON_T_LABEL),
+			   HWMON_T_INPUT | HWMON_T_LABEL | HWMON_T_LOWEST |
+			   HWMON_T_HIGHEST | HWMON_T_RESET_HISTORY |
+			   HWMON_T_MAX | HWMON_T_MAX_ALARM | HWMON_T_CRIT |
+			   HWMON_T_CRIT_ALARM | HWMON_T_FAULT),
 	HWMON_CHANNEL_INFO(fan,
-			   HWMON_F_INPUT | HWMON_F_LABEL,
-			   HWMON_F_INPUT | HWMON_F_LABEL),
+			   HWMON_F_INPUT | HWMON_F_LABEL | HWMON_F_MIN |
+			   HWMON_F_MIN_ALARM | HWMON_F_FAULT,
+			   HWMON_F_INPUT | HWMON_F_LABEL | HWMON_F_MIN |
+			   HWMON_F_MIN_ALARM | HWMON_F_FAULT),
 	NULL
 };
 
@@ -107,16 +487,9 @@ static const struct hwmon_chip_info kraken2_chip_info = {
 	.info = kraken2_info,
 };
 
-static int kraken2_raw_event(struct hid_device *hdev,
-			     struct hid_report *report, u8 *data, int size)
+/* Decodes a status report of at least 7 bytes, without touching any state */
+static void kraken2_decode_status(const u8 *data, s32 *temp_input, u16 *fan_input)
 {
-	struct kraken2_priv_data *priv;
-
-	if (size < 7 || report->id != STATUS_REPORT_ID)
-		return 0;
-
-	priv = hid_get_drvdata(hdev);
-
 	/*
 	 * The fractional byte of the coolant temperature has been observed to
 	 * be in the interval [1,9], but some of these steps are also
@@ -126,16 +499,82 @@ static int kraken2_raw_event(struct hid_device *hdev,
 	 * and that the missing steps are artifacts of how the firmware
 	 * processes the raw sensor data.
 	 */
-	priv->temp_input[0] = data[1] * 1000 + data[2] * 100;
+	temp_input[0] = data[1] * 1000 + data[2] * 100;
 
-	priv->fan_input[0] = get_unaligned_be16(data + 3);
-	priv->fan_input[1] = get_unaligned_be16(data + 5);
+	fan_input[0] = get_unaligned_be16(data + 3);
+	fan_input[1] = get_unaligned_be16(data + 5);
+}
 
+static int kraken2_raw_event(struct hid_device *hdev,
+			     struct hid_report *report, u8 *data, int size)
+{
+	struct kraken2_priv_data *priv;
+	struct {
+		s32 values[3];
+		s64 timestamp __aligned(8);
+	} scan;
+
+	trace_nzxt_hid_raw_event(hdev, report->id, size);
+
+	if (report->id != STATUS_REPORT_ID || size < 7)
+		return 0;
+
+	priv = hid_get_drvdata(hdev);
+
+	kraken2_decode_status(data, priv->temp_input, priv->fan_input);
 	priv->updated = jiffies;
 
+	trace_nzxt_hid_sensor(hdev, NZXT_HID_TEMP, 0, priv->temp_input[0]);
+	trace_nzxt_hid_sensor(hdev, NZXT_HID_FAN, 0, priv->fan_input[0]);
+	trace_nzxt_hid_sensor(hdev, NZXT_HID_FAN, 1, priv->fan_input[1]);
+
+	spin_lock(&priv->history_lock);
+	kraken2_history_add(&priv->history[HISTORY_TEMP], priv->temp_input[0]);
+	kraken2_history_add(&priv->history[HISTORY_FAN], priv->fan_input[0]);
+	kraken2_history_add(&priv->history[HISTORY_FAN + 1], priv->fan_input[1]);
+	spin_unlock(&priv->history_lock);
+
+	spin_lock(&priv->alarm_lock);
+	kraken2_check_alarms(priv);
+	if (priv->alarms_enabled)
+		mod_delayed_work(system_wq, &priv->stale_work, nzxt_hid_validity(&priv->staleness));
+	spin_unlock(&priv->alarm_lock);
+
+	/* The whole scan is copied into the buffer, padding included */
+	memset(&scan, 0, sizeof(scan));
+	scan.values[0] = priv->temp_input[0];
+	scan.values[1] = priv->fan_input[0];
+	scan.values[2] = priv->fan_input[1];
+	nzxt_hid_iio_push(priv->iio_dev, scan.values);
+
 	return 0;
 }
 
+static int age_show(struct seq_file *seqf, void *unused)
+{
+	struct kraken2_priv_data *priv = seqf->private;
+	unsigned long updated = READ_ONCE(priv->updated);
+
+	/* All sensors come in the same report */
+	nzxt_hid_show_age(seqf, "temp1", updated);
+	nzxt_hid_show_age(seqf, "fan1", updated);
+	nzxt_hid_show_age(seqf, "fan2", updated);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(age);
+
+static void kraken2_debugfs_init(struct kraken2_priv_data *priv)
+{
+	char name[64];
+
+	scnprintf(name, sizeof(name), "nzxt_kraken2-%s", dev_name(&priv->hid_dev->dev));
+
+	priv->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_file("age_ms", 0444, priv->debugfs, priv, &age_fops);
+	nzxt_hid_staleness_debugfs(priv->debugfs, &priv->staleness);
+}
+
 static int kraken2_probe(struct hid_device *hdev,
 			 const struct hid_device_id *id)
 {
@@ -147,14 +586,22 @@ static int kraken2_probe(struct hid_device *hdev,
 		return -ENOMEM;
 
 	priv->hid_dev = hdev;
+	spin_lock_init(&priv->history_lock);
+	spin_lock_init(&priv->alarm_lock);
+	INIT_WORK(&priv->alarm_work, kraken2_alarm_work);
+	INIT_DELAYED_WORK(&priv->stale_work, kraken2_stale_work);
 	hid_set_drvdata(hdev, priv);
 
 	/*
-	 * Initialize ->updated to STATUS_VALIDITY seconds in the past, making
-	 * the initial empty data invalid for kraken2_read without the need for
-	 * a special case there.
+	 * Initialize ->updated far enough in the past, making the initial empty
+	 * data invalid for kraken2_read without the need for a special case
+	 * there.
 	 */
-	priv->updated = jiffies - STATUS_VALIDITY * HZ;
+	priv->staleness.validity_ms = STATUS_VALIDITY * MSEC_PER_SEC;
+	priv->updated = nzxt_hid_never_updated();
+
+	priv->iio_dev = nzxt_hid_iio_register(hdev, "kraken2", kraken2_iio_channels,
+					      ARRAY_SIZE(kraken2_iio_channels));
 
 	ret = hid_parse(hdev);
 	if (ret) {
@@ -179,13 +626,23 @@ static int kraken2_probe(struct hid_device *hdev,
 
 	priv->hwmon_dev = hwmon_device_register_with_info(&hdev->dev, "kraken2",
 							  priv, &kraken2_chip_info,
-							  NULL);
+							  kraken2_history_groups);
 	if (IS_ERR(priv->hwmon_dev)) {
 		ret = PTR_ERR(priv->hwmon_dev);
 		hid_err(hdev, "hwmon registration failed with %d\n", ret);
 		goto fail_and_close;
 	}
 
+	/* Also catches a device that never sends anything */
+	spin_lock_bh(&priv->alarm_lock);
+	priv->alarms_enabled = true;
+	if (priv->alarms_changed)
+		schedule_work(&priv->alarm_work);
+	mod_delayed_work(system_wq, &priv->stale_work, nzxt_hid_validity(&priv->staleness));
+	spin_unlock_bh(&priv->alarm_lock);
+
+	kraken2_debugfs_init(priv);
+
 	return 0;
 
 fail_and_close:
@@ -199,7 +656,14 @@ static void kraken2_remove(struct hid_device *hdev)
 {
 	struct kraken2_priv_data *priv = hid_get_drvdata(hdev);
 
+	spin_lock_bh(&priv->alarm_lock);
+	priv->alarms_enabled = false;
+	spin_unlock_bh(&priv->alarm_lock);
+	cancel_delayed_work_sync(&priv->stale_work);
+	cancel_work_sync(&priv->alarm_work);
+
 	hwmon_device_unregister(priv->hwmon_dev);
+	debugfs_remove_recursive(priv->debugfs);
 
 	hid_hw_close(hdev);
 	hid_hw_stop(hdev);
@@ -212,11 +676,21 @@ static const struct hid_device_id kraken2_table[] = {
 
 MODULE_DEVICE_TABLE(hid, kraken2_table);
 
+/*
+ * The HID core only matches report types here; the report ID is checked in
+ * kraken2_raw_event().
+ */
+static const struct hid_report_id kraken2_report_table[] = {
+	{ HID_INPUT_REPORT },
+	{ HID_TERMINATOR }
+};
+
 static struct hid_driver kraken2_driver = {
 	.name = "nzxt-kraken2",
 	.id_table = kraken2_table,
 	.probe = kraken2_probe,
 	.remove = kraken2_remove,
+	.report_table = kraken2_report_table,
 	.raw_event = kraken2_raw_event,
 };
 
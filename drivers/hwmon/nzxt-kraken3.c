@@ -10,15 +10,21 @@
 
 #include <generated/uapi/linux/version.h>
 
+#include <linux/bitops.h>
 #include <linux/debugfs.h>
 #include <linux/hid.h>
 #include <linux/hwmon.h>
 #include <linux/hwmon-sysfs.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/seqlock.h>
 #include <linux/spinlock.h>
+#include <linux/sysfs.h>
+#include <linux/thermal.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #if KERNEL_VERSION(6, 12, 0) <= LINUX_VERSION_CODE
 #include <linux/unaligned.h>
@@ -26,6 +32,9 @@
 #include <asm/unaligned.h>
 #endif
 
+#include "nzxt-hid-common.h"
+#include "nzxt-hid-trace.h"
+
 #define USB_VENDOR_ID_NZXT		0x1e71
 #define USB_PRODUCT_ID_X53		0x2007
 #define USB_PRODUCT_ID_X53_SECOND	0x2014
@@ -33,15 +42,28 @@
 #define USB_PRODUCT_ID_KRAKEN2023	0x300E
 #define USB_PRODUCT_ID_KRAKEN2023_ELITE	0x300C
 
-enum kinds { X53, Z53, KRAKEN2023 } __packed;
-enum pwm_enable { off, manual, curve } __packed;
+enum pwm_enable { off, manual, curve, external } __packed;
 
 #define DRIVER_NAME		"nzxt_kraken3"
 #define STATUS_REPORT_ID	0x75
 #define FIRMWARE_REPORT_ID	0x11
-#define STATUS_VALIDITY		2000	/* In ms, equivalent to period of four status reports */
+#define STATUS_VALIDITY_REPORTS	4	/* Data is valid for the period of four status reports */
+#define REPLY_TIMEOUT		2000	/* In ms */
+#define UPDATE_INTERVAL_DEFAULT_MS	500
 #define CUSTOM_CURVE_POINTS	40	/* For temps from 20C to 59C (critical temp) */
 #define PUMP_DUTY_MIN		20	/* In percent */
+#define STATUS_PREFETCH_MIN	100	/* In ms */
+#define EXTERNAL_TEMP_MIN	20	/* In C, temp of the first curve point */
+
+static unsigned int status_prefetch_interval;
+module_param(status_prefetch_interval, uint, 0444);
+MODULE_PARM_DESC(status_prefetch_interval,
+		 "Z53/Kraken 2023 status prefetch period in ms (0 to disable, default)");
+
+static unsigned int curve_flush_delay;
+module_param(curve_flush_delay, uint, 0644);
+MODULE_PARM_DESC(curve_flush_delay,
+		 "Delay in ms for merging curve point changes into one upload (0 to disable)");
 
 /* Sensor report offsets for Kraken X53 and Z53 */
 #define TEMP_SENSOR_START_OFFSET	15
@@ -58,10 +80,11 @@ enum pwm_enable { off, manual, curve } __packed;
 
 /* Report offsets for control commands for Kraken X53 and Z53 */
 #define SET_DUTY_ID_OFFSET		1
+#define SET_INTERVAL_OFFSET		4
 
 /* Control commands and their lengths for Kraken X53 and Z53 */
 
-/* Last byte sets the report interval at 0.5s */
+/* Last byte sets the report interval, 0.5s by default */
 static const u8 set_interval_cmd[] = { 0x70, 0x02, 0x01, 0xB8, 1 };
 static const u8 finish_init_cmd[] = { 0x70, 0x01 };
 static const u8 __maybe_unused get_fw_version_cmd[] = { 0x10, 0x01 };
@@ -78,6 +101,63 @@ static const u8 z53_get_status_cmd[] = { 0x74, 0x01 };
 #define SET_CURVE_DUTY_CMD_LENGTH		(4 + 40)
 #define Z53_GET_STATUS_CMD_LENGTH		2
 
+/*
+ * Per-model report layout and quirks, picked through the driver_data of kraken3_table. A model
+ * that only differs in these needs nothing but a new descriptor.
+ */
+struct kraken3_model {
+	const char *name;	/* Of the hwmon device */
+	int channels;		/* Pump, followed by the fan if there are two */
+	bool pushes_status;	/* Sends status reports on its own, instead of on request */
+	u8 speed_offset[2];	/* In status reports, per channel */
+	u8 duty_offset[2];
+	u8 curve_flags[2];	/* Number of 1s after SET_DUTY_ID_OFFSET in curve commands */
+	const char *const *notify_attrs;	/* Notified after each status report */
+};
+
+static const char *const kraken3_notify_attrs_pump[] = {
+	"temp1_input", "fan1_input", "pwm1", NULL
+};
+
+static const char *const kraken3_notify_attrs_pump_fan[] = {
+	"temp1_input", "fan1_input", "pwm1", "fan2_input", "pwm2", NULL
+};
+
+static const struct kraken3_model kraken3_x53 = {
+	.name = "x53",
+	.channels = 1,
+	.pushes_status = true,
+	.speed_offset = { PUMP_SPEED_OFFSET },
+	.duty_offset = { PUMP_DUTY_OFFSET },
+	.notify_attrs = kraken3_notify_attrs_pump,
+};
+
+static const struct kraken3_model kraken3_z53 = {
+	.name = "z53",
+	.channels = 2,
+	.speed_offset = { PUMP_SPEED_OFFSET, Z53_FAN_SPEED_OFFSET },
+	.duty_offset = { PUMP_DUTY_OFFSET, Z53_FAN_DUTY_OFFSET },
+	.notify_attrs = kraken3_notify_attrs_pump_fan,
+};
+
+static const struct kraken3_model kraken3_2023 = {
+	.name = "kraken2023",
+	.channels = 2,
+	.speed_offset = { PUMP_SPEED_OFFSET, Z53_FAN_SPEED_OFFSET },
+	.duty_offset = { PUMP_DUTY_OFFSET, Z53_FAN_DUTY_OFFSET },
+	.curve_flags = { 1, 2 },
+	.notify_attrs = kraken3_notify_attrs_pump_fan,
+};
+
+static const struct kraken3_model kraken3_2023_elite = {
+	.name = "kraken2023elite",
+	.channels = 2,
+	.speed_offset = { PUMP_SPEED_OFFSET, Z53_FAN_SPEED_OFFSET },
+	.duty_offset = { PUMP_DUTY_OFFSET, Z53_FAN_DUTY_OFFSET },
+	.curve_flags = { 1, 2 },
+	.notify_attrs = kraken3_notify_attrs_pump_fan,
+};
+
 static const char *const kraken3_temp_label[] = {
 	"Coolant temp",
 };
@@ -87,44 +167,111 @@ static const char *const kraken3_fan_label[] = {
 	"Fan speed"
 };
 
+static const char *const kraken3_cooling_type[] = {
+	"nzxt-kraken3-pump",
+	"nzxt-kraken3-fan"
+};
+
 struct kraken3_channel_info {
 	enum pwm_enable mode;
-
-	/* Both values are PWM */
-	u16 reported_duty;
-	u16 fixed_duty;		/* Manually set fixed duty */
+	bool mode_set;		/* Whether mode was ever written, so it's replayed after a reset */
+	u16 fixed_duty;		/* Manually set fixed duty, in PWM */
 
 	u8 pwm_points[CUSTOM_CURVE_POINTS];
+
+	/* For the external mode, where pwm_points are applied to the temp of a thermal zone */
+	char temp_source[THERMAL_NAME_LENGTH];
+	int temp_hyst;		/* In millidegrees C */
+	int last_temp;		/* Last temp the duty was set for, in millidegrees C */
+	bool last_temp_valid;
+
+	/* Last curve successfully sent to the device, in percent */
+	u8 sent_curve[CUSTOM_CURVE_POINTS];
+	bool sent_curve_valid;
+};
+
+/* I/O statistics, shown in debugfs */
+struct kraken3_stats {
+	atomic_long_t status_reports;
+	atomic_long_t faulty_reports;
+	atomic_long_t requests_sent;	/* Z53 status requests */
+
+	/* log2 histograms, in us */
+	atomic_long_t reply_latency[NZXT_HID_HIST_BUCKETS];
+	atomic_long_t control_lock_wait[NZXT_HID_HIST_BUCKETS];
+};
+
+/* Values parsed from a single status report */
+struct kraken3_status {
+	s32 temp_input[1];
+	u16 fan_input[2];
+	u16 reported_duty[2];	/* In PWM, for pump and fan */
+	bool is_device_faulty;
+
+	unsigned long updated;	/* jiffies */
+};
+
+/* Coolant temperature, then pump and fan speeds */
+static const struct iio_chan_spec kraken3_iio_channels[] = {
+	NZXT_HID_IIO_CHAN(IIO_TEMP, 0, 0),
+	NZXT_HID_IIO_CHAN(IIO_ANGL_VEL, 0, 1),
+	NZXT_HID_IIO_CHAN(IIO_ANGL_VEL, 1, 2),
+	IIO_CHAN_SOFT_TIMESTAMP(3),
 };
 
 struct kraken3_data {
 	struct hid_device *hdev;
 	struct device *hwmon_dev;
+	struct iio_dev *iio_dev;	/* Optional */
+	struct nzxt_hid_cooling cooling[2];	/* Pump and fan, optional */
 	struct dentry *debugfs;
-	struct mutex buffer_lock;	/* For locking access to buffer */
-	struct mutex z53_status_request_lock;
+	struct nzxt_hid_out out;
+	struct mutex control_lock;	/* For locking access to channel_info */
 	struct completion fw_version_processed;
+	/* Queries the firmware version without holding up probe */
+	struct work_struct fw_version_work;
+	/* Periodically requests status reports on Z53 devices, if enabled */
+	struct delayed_work status_prefetch_work;
+	/* Uploads the curves of channels in curve_flush_pending, after curve_flush_delay */
+	struct delayed_work curve_flush_work;
+	unsigned long curve_flush_pending;
+	/* Reinitializes the device and replays channel_info after a reset_resume */
+	struct work_struct resume_work;
+	bool resuming;	/* Until resume_work is done, reads are served from the cache */
+	/* Notifies pollers of the sensor attributes after a status report was parsed */
+	struct nzxt_hid_notify notify;
+	/* Applies the curves of channels in the external mode, every update_interval */
+	struct delayed_work external_work;
 	/*
 	 * For X53 devices, tracks whether an initial (one) sensor report was received to
 	 * make fancontrol not bail outright. For Z53 devices, whether a status report
 	 * was processed after requesting one.
 	 */
 	struct completion status_report_processed;
-	/* For locking the above completion */
+	/* For locking the above completion and serializing writers of status */
 	spinlock_t status_completion_lock;
+	/* Lets readers take a consistent snapshot of status without locking */
+	seqcount_spinlock_t status_seq;
+	/*
+	 * Z53 status request in flight, if any, which readers wait on instead of sending
+	 * their own (see kraken3_read_z53()). Protected by status_completion_lock.
+	 */
+	bool status_request_pending;
+	unsigned long status_request_expires;	/* jiffies */
+	ktime_t status_request_sent;
+	int status_request_ret;
+	unsigned long status_requests_coalesced;
 
-	u8 *buffer;
 	struct kraken3_channel_info channel_info[2];	/* Pump and fan */
-	bool is_device_faulty;
-
-	/* Sensor values */
-	s32 temp_input[1];
-	u16 fan_input[2];
+	struct kraken3_status status;
+	struct kraken3_stats stats;
 
-	enum kinds kind;
+	const struct kraken3_model *model;
 	u8 firmware_version[3];
 
-	unsigned long updated;	/* jiffies */
+	long update_interval;	/* In ms, written under control_lock */
+	/* The validity is reset to STATUS_VALIDITY_REPORTS update intervals along with it */
+	struct nzxt_hid_staleness staleness;
 };
 
 static umode_t kraken3_is_visible(const void *data, enum hwmon_sensor_types type, u32 attr,
@@ -138,41 +285,19 @@ static umode_t kraken3_is_visible(const void *data, enum hwmon_sensor_types type
 			return 0444;
 		break;
 	case hwmon_fan:
-		switch (priv->kind) {
-		case X53:
-			/* Just the pump */
-			if (channel < 1)
-				return 0444;
-			break;
-		case Z53:
-		case KRAKEN2023:
-			/* Pump and fan */
-			if (channel < 2)
-				return 0444;
-			break;
-		default:
-			break;
-		}
+		if (channel < priv->model->channels)
+			return 0444;
+		break;
+	case hwmon_chip:
+		if (attr == hwmon_chip_update_interval)
+			return 0644;
 		break;
 	case hwmon_pwm:
 		switch (attr) {
 		case hwmon_pwm_enable:
 		case hwmon_pwm_input:
-			switch (priv->kind) {
-			case X53:
-				/* Just the pump */
-				if (channel < 1)
-					return 0644;
-				break;
-			case Z53:
-			case KRAKEN2023:
-				/* Pump and fan */
-				if (channel < 2)
-					return 0644;
-				break;
-			default:
-				break;
-			}
+			if (channel < priv->model->channels)
+				return 0644;
 			break;
 		default:
 			break;
@@ -185,21 +310,22 @@ static umode_t kraken3_is_visible(const void *data, enum hwmon_sensor_types type
 	return 0;
 }
 
+/* Takes control_lock, accounting for the time spent waiting for it */
+static void kraken3_lock_control(struct kraken3_data *priv)
+{
+	ktime_t start = ktime_get();
+
+	mutex_lock(&priv->control_lock);
+	nzxt_hid_hist_add(priv->stats.control_lock_wait, ktime_us_delta(ktime_get(), start));
+}
+
 /*
  * Writes the command to the device with the rest of the report (up to 64 bytes) filled
  * with zeroes.
  */
 static int kraken3_write_expanded(struct kraken3_data *priv, const u8 *cmd, int cmd_length)
 {
-	int ret;
-
-	mutex_lock(&priv->buffer_lock);
-
-	memcpy_and_pad(priv->buffer, MAX_REPORT_LENGTH, cmd, cmd_length, 0x00);
-	ret = hid_hw_output_report(priv->hdev, priv->buffer, MAX_REPORT_LENGTH);
-
-	mutex_unlock(&priv->buffer_lock);
-	return ret;
+	return nzxt_hid_send(&priv->out, cmd, cmd_length);
 }
 
 static int kraken3_percent_to_pwm(long val)
@@ -223,6 +349,34 @@ static int kraken3_pwm_to_percent(long val, int channel)
 	return percent_value;
 }
 
+static void kraken3_get_status(struct kraken3_data *priv, struct kraken3_status *status)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&priv->status_seq);
+		*status = priv->status;
+	} while (read_seqcount_retry(&priv->status_seq, seq));
+}
+
+/* Scales with the update interval, unless changed through debugfs since it was last set */
+static unsigned long kraken3_status_validity(struct kraken3_data *priv)
+{
+	return nzxt_hid_validity(&priv->staleness);
+}
+
+static bool kraken3_status_is_stale(struct kraken3_data *priv,
+				    const struct kraken3_status *status)
+{
+	return nzxt_hid_is_stale(&priv->staleness, status->updated);
+}
+
+/* Waits for kraken3_raw_event() to complete status_report_processed */
+static int kraken3_wait_for_status(struct kraken3_data *priv, unsigned long timeout)
+{
+	return nzxt_hid_wait_for_reply(&priv->out, &priv->status_report_processed, timeout);
+}
+
 static int kraken3_read_x53(struct kraken3_data *priv)
 {
 	int ret;
@@ -238,86 +392,181 @@ static int kraken3_read_x53(struct kraken3_data *priv)
 	/*
 	 * Data needs to be read, but a sensor report wasn't yet received. It's usually
 	 * fancontrol that requests data this early and it exits if it reads an error code.
-	 * So, wait for the first report to be parsed (but up to STATUS_VALIDITY).
+	 * So, wait for the first report to be parsed (but up to the validity period).
 	 * This does not concern the Z series devices, because they send a sensor report
 	 * only when requested.
 	 */
-	ret = wait_for_completion_interruptible_timeout(&priv->status_report_processed,
-							msecs_to_jiffies(STATUS_VALIDITY));
-	if (ret == 0)
-		return -ETIMEDOUT;
-	else if (ret < 0)
+	ret = kraken3_wait_for_status(priv, kraken3_status_validity(priv));
+	if (ret < 0)
 		return ret;
 
 	/* The first sensor report was parsed on time and reading can continue */
 	return 0;
 }
 
-/* Covers Z53 and KRAKEN2023 device kinds */
-static int kraken3_read_z53(struct kraken3_data *priv)
+/*
+ * Starts a new Z53 status request, unless one is already in flight and its reply can still
+ * be expected. Returns whether the caller should send the request.
+ *
+ * Caller must hold priv->status_completion_lock.
+ */
+static bool kraken3_start_status_request(struct kraken3_data *priv)
 {
-	int ret = mutex_lock_interruptible(&priv->z53_status_request_lock);
+	if (priv->status_request_pending && time_before(jiffies, priv->status_request_expires))
+		return false;
 
-	if (ret < 0)
-		return ret;
+	/* hidraw calls could have completed readers in the meantime, so reinit */
+	reinit_completion(&priv->status_report_processed);
+	priv->status_request_pending = true;
+	priv->status_request_expires = jiffies + msecs_to_jiffies(REPLY_TIMEOUT);
+	priv->status_request_ret = 0;
+	priv->status_request_sent = ktime_get();
 
-	if (!time_after(jiffies, priv->updated + msecs_to_jiffies(STATUS_VALIDITY))) {
-		/* Data is up to date */
-		goto unlock_and_return;
-	}
+	return true;
+}
 
-	/*
-	 * Disable interrupts for a moment to safely reinit the completion,
-	 * as hidraw calls could have allowed one or more readers to complete.
-	 */
+/* Sends the status request started by kraken3_start_status_request() */
+static int kraken3_send_status_request(struct kraken3_data *priv)
+{
+	int ret;
+
+	atomic_long_inc(&priv->stats.requests_sent);
+	trace_nzxt_hid_status_request(priv->hdev);
+
+	ret = kraken3_write_expanded(priv, z53_get_status_cmd, Z53_GET_STATUS_CMD_LENGTH);
+	if (ret == 0)
+		return 0;
+
+	/* No reply is coming, so wake up anyone waiting for it */
 	spin_lock_bh(&priv->status_completion_lock);
-	reinit_completion(&priv->status_report_processed);
+	priv->status_request_pending = false;
+	priv->status_request_ret = ret;
+	complete_all(&priv->status_report_processed);
 	spin_unlock_bh(&priv->status_completion_lock);
 
-	/* Send command for getting status */
-	ret = kraken3_write_expanded(priv, z53_get_status_cmd, Z53_GET_STATUS_CMD_LENGTH);
-	if (ret < 0)
-		goto unlock_and_return;
+	trace_nzxt_hid_status_complete(priv->hdev, ret, 0);
 
-	/* Wait for completion from kraken3_raw_event() */
-	ret = wait_for_completion_interruptible_timeout(&priv->status_report_processed,
-							msecs_to_jiffies(STATUS_VALIDITY));
-	if (ret == 0)
-		ret = -ETIMEDOUT;
+	return ret;
+}
+
+/*
+ * Covers the models that only send status reports on request (Z53 and Kraken 2023). The first
+ * reader to find stale data sends a status request, and any others that come while it's in
+ * flight just wait for the same reply.
+ */
+static int kraken3_read_z53(struct kraken3_data *priv)
+{
+	struct kraken3_status status;
+	bool send_request = false;
+	int ret;
+
+	spin_lock_bh(&priv->status_completion_lock);
+
+	/* A reply could have arrived in the meantime */
+	kraken3_get_status(priv, &status);
+	if (!kraken3_status_is_stale(priv, &status)) {
+		spin_unlock_bh(&priv->status_completion_lock);
+		return 0;
+	}
+
+	send_request = kraken3_start_status_request(priv);
+	if (!send_request)
+		priv->status_requests_coalesced++;
+
+	spin_unlock_bh(&priv->status_completion_lock);
+
+	if (send_request) {
+		ret = kraken3_send_status_request(priv);
+		if (ret < 0)
+			return ret;
+	}
 
-unlock_and_return:
-	mutex_unlock(&priv->z53_status_request_lock);
+	ret = kraken3_wait_for_status(priv, msecs_to_jiffies(REPLY_TIMEOUT));
 	if (ret < 0)
 		return ret;
 
-	return 0;
+	/* Set if the request failed to be sent by someone else */
+	return READ_ONCE(priv->status_request_ret);
+}
+
+/*
+ * Requests a status report from Z53 devices at status_prefetch_interval, without waiting for
+ * it. The reply is parsed in kraken3_raw_event() like any other, so data stays fresh and
+ * kraken3_read() doesn't have to fall back to kraken3_read_z53() and wait for the device.
+ */
+static void kraken3_status_prefetch_work(struct work_struct *work)
+{
+	struct kraken3_data *priv = container_of(to_delayed_work(work), struct kraken3_data,
+						 status_prefetch_work);
+	unsigned int interval;
+	bool send_request;
+	int ret;
+
+	/* Readers that find stale data in the meantime can wait for this request, too */
+	spin_lock_bh(&priv->status_completion_lock);
+	send_request = kraken3_start_status_request(priv);
+	spin_unlock_bh(&priv->status_completion_lock);
+
+	if (send_request) {
+		ret = kraken3_send_status_request(priv);
+		if (ret < 0)
+			hid_dbg(priv->hdev, "status prefetch failed with %d\n", ret);
+	}
+
+	/* Keep at least two requests within the validity period, so a single lost reply is fine */
+	interval = clamp_val(status_prefetch_interval, STATUS_PREFETCH_MIN,
+			     READ_ONCE(priv->update_interval) * STATUS_VALIDITY_REPORTS / 2);
+	queue_delayed_work(system_freezable_wq, &priv->status_prefetch_work,
+			   msecs_to_jiffies(interval));
 }
 
 static int kraken3_read(struct device *dev, enum hwmon_sensor_types type, u32 attr, int channel,
 			long *val)
 {
 	struct kraken3_data *priv = dev_get_drvdata(dev);
+	struct kraken3_status status;
 	int ret;
 
-	if (time_after(jiffies, priv->updated + msecs_to_jiffies(STATUS_VALIDITY))) {
-		if (priv->kind == X53)
+	if (type == hwmon_chip) {
+		switch (attr) {
+		case hwmon_chip_update_interval:
+			*val = READ_ONCE(priv->update_interval);
+			return 0;
+		default:
+			return -EOPNOTSUPP;
+		}
+	}
+
+	kraken3_get_status(priv, &status);
+	if (READ_ONCE(priv->resuming)) {
+		/* Don't wait for the device while it's being restored, but don't serve bad data */
+		if (status.is_device_faulty ||
+		    nzxt_hid_is_expired(&priv->staleness, status.updated))
+			return -ENODATA;
+	} else if (kraken3_status_is_stale(priv, &status)) {
+		if (priv->model->pushes_status)
 			ret = kraken3_read_x53(priv);
 		else
 			ret = kraken3_read_z53(priv);
 
-		if (ret < 0)
-			return ret;
-
-		if (priv->is_device_faulty)
-			return -ENODATA;
+		if (ret < 0) {
+			/* Serve the last values instead, if still within the grace period */
+			if (status.is_device_faulty ||
+			    nzxt_hid_is_expired(&priv->staleness, status.updated))
+				return ret;
+		} else {
+			kraken3_get_status(priv, &status);
+			if (status.is_device_faulty)
+				return -ENODATA;
+		}
 	}
 
 	switch (type) {
 	case hwmon_temp:
-		*val = priv->temp_input[channel];
+		*val = status.temp_input[channel];
 		break;
 	case hwmon_fan:
-		*val = priv->fan_input[channel];
+		*val = status.fan_input[channel];
 		break;
 	case hwmon_pwm:
 		switch (attr) {
@@ -325,7 +574,7 @@ static int kraken3_read(struct device *dev, enum hwmon_sensor_types type, u32 at
 			*val = priv->channel_info[channel].mode;
 			break;
 		case hwmon_pwm_input:
-			*val = priv->channel_info[channel].reported_duty;
+			*val = status.reported_duty[channel];
 			break;
 		default:
 			return -EOPNOTSUPP;
@@ -355,40 +604,51 @@ static int kraken3_read_string(struct device *dev, enum hwmon_sensor_types type,
 	return 0;
 }
 
-/* Writes custom curve to device */
+/*
+ * Writes custom curve to device, unless it's the same as the one last sent for the channel.
+ * Clearing sent_curve_valid forces the next one to be sent regardless.
+ *
+ * Caller must hold priv->control_lock.
+ */
 static int kraken3_write_curve(struct kraken3_data *priv, u8 *curve_array, int channel)
 {
+	struct kraken3_channel_info *info = &priv->channel_info[channel];
 	u8 fixed_duty_cmd[SET_CURVE_DUTY_CMD_LENGTH];
 	int ret;
 
+	if (info->sent_curve_valid &&
+	    !memcmp(info->sent_curve, curve_array, CUSTOM_CURVE_POINTS))
+		return 0;
+
 	/* Copy command header */
 	memcpy(fixed_duty_cmd, set_pump_duty_cmd_header, SET_CURVE_DUTY_CMD_HEADER_LENGTH);
 
 	/* Set the correct ID for writing pump/fan duty (0x01 or 0x02, respectively) */
 	fixed_duty_cmd[SET_DUTY_ID_OFFSET] = channel + 1;
 
-	if (priv->kind == KRAKEN2023) {
-		/* These require 1s in the next one or two slots after SET_DUTY_ID_OFFSET */
-		fixed_duty_cmd[SET_DUTY_ID_OFFSET + 1] = 1;
-		if (channel == 1) /* Fan */
-			fixed_duty_cmd[SET_DUTY_ID_OFFSET + 2] = 1;
-	}
+	/* Kraken 2023 models require 1s in the next one or two slots */
+	memset(fixed_duty_cmd + SET_DUTY_ID_OFFSET + 1, 1, priv->model->curve_flags[channel]);
 
 	/* Copy curve to command */
 	memcpy(fixed_duty_cmd + SET_CURVE_DUTY_CMD_HEADER_LENGTH, curve_array, CUSTOM_CURVE_POINTS);
 
 	ret = kraken3_write_expanded(priv, fixed_duty_cmd, SET_CURVE_DUTY_CMD_LENGTH);
-	return ret;
+	if (ret < 0) {
+		/* Whether the device got it is unknown */
+		info->sent_curve_valid = false;
+		return ret;
+	}
+
+	memcpy(info->sent_curve, curve_array, CUSTOM_CURVE_POINTS);
+	info->sent_curve_valid = true;
+
+	return 0;
 }
 
-static int kraken3_write_fixed_duty(struct kraken3_data *priv, long val, int channel)
+static int kraken3_write_fixed_percent(struct kraken3_data *priv, u8 percent_val, int channel)
 {
 	u8 fixed_curve_points[CUSTOM_CURVE_POINTS];
-	int ret, percent_val, i;
-
-	percent_val = kraken3_pwm_to_percent(val, channel);
-	if (percent_val < 0)
-		return percent_val;
+	int ret, i;
 
 	/*
 	 * The devices can only control the duty through a curve.
@@ -410,74 +670,242 @@ static int kraken3_write_fixed_duty(struct kraken3_data *priv, long val, int cha
 	return ret;
 }
 
-static int kraken3_write(struct device *dev, enum hwmon_sensor_types type, u32 attr, int channel,
-			 long val)
+static int kraken3_write_fixed_duty(struct kraken3_data *priv, long val, int channel)
+{
+	int percent_val;
+
+	percent_val = kraken3_pwm_to_percent(val, channel);
+	if (percent_val < 0)
+		return percent_val;
+
+	return kraken3_write_fixed_percent(priv, percent_val, channel);
+}
+
+/*
+ * Temps of the thermal zones that channels follow in the external mode, read without holding
+ * priv->control_lock: thermal_zone_get_temp() takes the lock of the zone, which the thermal core
+ * holds while it calls kraken3_set_cooling_pwm(), which takes control_lock.
+ */
+struct kraken3_external_temps {
+	char source[2][THERMAL_NAME_LENGTH];	/* What each temp was read from */
+	int temp[2];				/* In millidegrees C, if ret is 0 */
+	int ret[2];
+};
+
+/* Caller must not hold priv->control_lock, and must have set temps->source[channel] */
+static void kraken3_read_external_temp(struct kraken3_external_temps *temps, int channel)
+{
+	struct thermal_zone_device *tz;
+
+	if (!temps->source[channel][0]) {
+		temps->ret[channel] = -EINVAL;
+		return;
+	}
+
+	tz = thermal_zone_get_zone_by_name(temps->source[channel]);
+	if (IS_ERR(tz))
+		temps->ret[channel] = PTR_ERR(tz);
+	else
+		temps->ret[channel] = thermal_zone_get_temp(tz, &temps->temp[channel]);
+}
+
+/*
+ * Reads the temps of the current sources of the channels in mask.
+ *
+ * Caller must not hold priv->control_lock.
+ */
+static void kraken3_read_external_temps(struct kraken3_data *priv, unsigned long mask,
+					struct kraken3_external_temps *temps)
+{
+	int channel;
+
+	kraken3_lock_control(priv);
+	for_each_set_bit(channel, &mask, ARRAY_SIZE(temps->source))
+		strscpy(temps->source[channel], priv->channel_info[channel].temp_source,
+			sizeof(temps->source[channel]));
+	mutex_unlock(&priv->control_lock);
+
+	for_each_set_bit(channel, &mask, ARRAY_SIZE(temps->source))
+		kraken3_read_external_temp(temps, channel);
+}
+
+/*
+ * Sets the duty of a channel in the external mode, by looking up the temp of its thermal zone,
+ * as read by the caller into temps, in its curve. The duty only goes down once the temp has
+ * dropped by more than temp_hyst, and kraken3_write_curve() skips the upload unless the duty
+ * actually changed. If the temp couldn't be read, the duty is set to 100% for safety.
+ *
+ * Caller must hold priv->control_lock.
+ */
+static int kraken3_apply_external(struct kraken3_data *priv, int channel,
+				  const struct kraken3_external_temps *temps)
+{
+	struct kraken3_channel_info *info = &priv->channel_info[channel];
+	int temp, point, ret;
+
+	/*
+	 * The source changed since the temp was read; the new one is applied by
+	 * kraken3_temp_source_store() or the next kraken3_external_work()
+	 */
+	if (strcmp(temps->source[channel], info->temp_source))
+		return 0;
+
+	ret = temps->ret[channel];
+	temp = temps->temp[channel];
+
+	if (ret < 0) {
+		dev_warn_ratelimited(&priv->hdev->dev, "reading temp of %s failed with %d\n",
+				     info->temp_source, ret);
+		info->last_temp_valid = false;
+		return kraken3_write_fixed_percent(priv, 100, channel);
+	}
+
+	if (info->last_temp_valid && temp < info->last_temp &&
+	    info->last_temp - temp <= info->temp_hyst)
+		temp = info->last_temp;
+
+	info->last_temp = temp;
+	info->last_temp_valid = true;
+
+	point = clamp_val(temp / 1000 - EXTERNAL_TEMP_MIN, 0, CUSTOM_CURVE_POINTS - 1);
+	return kraken3_write_fixed_percent(priv, info->pwm_points[point], channel);
+}
+
+static void kraken3_external_work(struct work_struct *work)
+{
+	struct kraken3_data *priv = container_of(to_delayed_work(work), struct kraken3_data,
+						 external_work);
+	struct kraken3_external_temps temps;
+	unsigned long mask = 0;
+	bool reschedule = false;
+	int channel, ret;
+
+	kraken3_lock_control(priv);
+	for (channel = 0; channel < ARRAY_SIZE(priv->channel_info); channel++)
+		if (priv->channel_info[channel].mode == external)
+			mask |= BIT(channel);
+	mutex_unlock(&priv->control_lock);
+
+	/* Stop once no channel is in the external mode anymore */
+	if (!mask)
+		return;
+
+	kraken3_read_external_temps(priv, mask, &temps);
+
+	kraken3_lock_control(priv);
+
+	for (channel = 0; channel < ARRAY_SIZE(priv->channel_info); channel++) {
+		if (priv->channel_info[channel].mode != external)
+			continue;
+
+		reschedule = true;
+
+		/* Switched to the external mode meanwhile, which applied the curve already */
+		if (!(mask & BIT(channel)))
+			continue;
+
+		ret = kraken3_apply_external(priv, channel, &temps);
+		if (ret < 0)
+			dev_warn_ratelimited(&priv->hdev->dev,
+					     "setting duty of channel %d failed with %d\n",
+					     channel, ret);
+	}
+
+	if (reschedule)
+		queue_delayed_work(system_freezable_wq, &priv->external_work,
+				   msecs_to_jiffies(priv->update_interval));
+
+	mutex_unlock(&priv->control_lock);
+}
+
+/*
+ * Caller must hold priv->control_lock. temps is only needed to set the external mode, and must then
+ * have been read by kraken3_read_external_temps() for the channel.
+ */
+static int kraken3_write_pwm(struct kraken3_data *priv, u32 attr, int channel, long val,
+			     const struct kraken3_external_temps *temps)
 {
-	struct kraken3_data *priv = dev_get_drvdata(dev);
 	int ret;
 
-	switch (type) {
-	case hwmon_pwm:
-		switch (attr) {
-		case hwmon_pwm_input:
-			/* Remember the last set fixed duty for channel */
-			priv->channel_info[channel].fixed_duty = val;
-
-			if (priv->channel_info[channel].mode == manual) {
-				ret = kraken3_write_fixed_duty(priv, val, channel);
-				if (ret < 0)
-					return ret;
-
-				/*
-				 * Lock onto this value and report it until next interrupt status
-				 * report is received, so userspace tools can continue to work.
-				 */
-				priv->channel_info[channel].reported_duty = val;
-			}
+	switch (attr) {
+	case hwmon_pwm_input:
+		/* Remember the last set fixed duty for channel */
+		priv->channel_info[channel].fixed_duty = val;
+
+		if (priv->channel_info[channel].mode == manual) {
+			ret = kraken3_write_fixed_duty(priv, val, channel);
+			if (ret < 0)
+				return ret;
+
+			/*
+			 * Lock onto this value and report it until next interrupt status
+			 * report is received, so userspace tools can continue to work.
+			 */
+			spin_lock_bh(&priv->status_completion_lock);
+			write_seqcount_begin(&priv->status_seq);
+			priv->status.reported_duty[channel] = val;
+			write_seqcount_end(&priv->status_seq);
+			spin_unlock_bh(&priv->status_completion_lock);
+		}
+		break;
+	case hwmon_pwm_enable:
+		if (val < 0 || val > 3)
+			return -EINVAL;
+
+		/* Always resend when the mode is (re)set, in case the device state diverged */
+		priv->channel_info[channel].sent_curve_valid = false;
+
+		switch (val) {
+		case 0:
+			/* Set channel to 100%, direct duty value */
+			ret = kraken3_write_fixed_duty(priv, 255, channel);
+			if (ret < 0)
+				return ret;
+
+			/* We don't control anything anymore */
+			priv->channel_info[channel].mode = off;
 			break;
-		case hwmon_pwm_enable:
-			if (val < 0 || val > 2)
+		case 1:
+			/* Apply the last known direct duty value */
+			ret =
+			    kraken3_write_fixed_duty(priv,
+						     priv->channel_info[channel].fixed_duty,
+						     channel);
+			if (ret < 0)
+				return ret;
+
+			priv->channel_info[channel].mode = manual;
+			break;
+		case 2:
+			/* Apply the curve and note as enabled */
+			ret =
+			    kraken3_write_curve(priv,
+						priv->channel_info[channel].pwm_points,
+						channel);
+			if (ret < 0)
+				return ret;
+
+			priv->channel_info[channel].mode = curve;
+			break;
+		case 3:
+			/* Follow the temp of a thermal zone, see kraken3_external_work() */
+			if (!priv->channel_info[channel].temp_source[0] || !temps)
 				return -EINVAL;
 
-			switch (val) {
-			case 0:
-				/* Set channel to 100%, direct duty value */
-				ret = kraken3_write_fixed_duty(priv, 255, channel);
-				if (ret < 0)
-					return ret;
-
-				/* We don't control anything anymore */
-				priv->channel_info[channel].mode = off;
-				break;
-			case 1:
-				/* Apply the last known direct duty value */
-				ret =
-				    kraken3_write_fixed_duty(priv,
-							     priv->channel_info[channel].fixed_duty,
-							     channel);
-				if (ret < 0)
-					return ret;
-
-				priv->channel_info[channel].mode = manual;
-				break;
-			case 2:
-				/* Apply the curve and note as enabled */
-				ret =
-				    kraken3_write_curve(priv,
-							priv->channel_info[channel].pwm_points,
-							channel);
-				if (ret < 0)
-					return ret;
-
-				priv->channel_info[channel].mode = curve;
-				break;
-			default:
-				break;
-			}
+			priv->channel_info[channel].last_temp_valid = false;
+			ret = kraken3_apply_external(priv, channel, temps);
+			if (ret < 0)
+				return ret;
+
+			priv->channel_info[channel].mode = external;
+			mod_delayed_work(system_freezable_wq, &priv->external_work,
+					 msecs_to_jiffies(priv->update_interval));
 			break;
 		default:
-			return -EOPNOTSUPP;
+			break;
 		}
+
+		priv->channel_info[channel].mode_set = true;
 		break;
 	default:
 		return -EOPNOTSUPP;
@@ -486,11 +914,74 @@ static int kraken3_write(struct device *dev, enum hwmon_sensor_types type, u32 a
 	return 0;
 }
 
+/* Caller must hold priv->control_lock, or otherwise ensure exclusive access */
+static int kraken3_set_update_interval(struct kraken3_data *priv, long val)
+{
+	u8 cmd[SET_INTERVAL_CMD_LENGTH];
+	int ret;
+
+	memcpy(cmd, set_interval_cmd, SET_INTERVAL_CMD_LENGTH);
+	cmd[SET_INTERVAL_OFFSET] = nzxt_hid_interval_to_byte(val);
+
+	ret = kraken3_write_expanded(priv, cmd, SET_INTERVAL_CMD_LENGTH);
+	if (ret < 0)
+		return ret;
+
+	WRITE_ONCE(priv->update_interval,
+		   nzxt_hid_byte_to_interval(cmd[SET_INTERVAL_OFFSET]));
+	WRITE_ONCE(priv->staleness.validity_ms, priv->update_interval * STATUS_VALIDITY_REPORTS);
+	return 0;
+}
+
+static int kraken3_write(struct device *dev, enum hwmon_sensor_types type, u32 attr, int channel,
+			 long val)
+{
+	struct kraken3_data *priv = dev_get_drvdata(dev);
+	struct kraken3_external_temps temps;
+	int ret;
+
+	switch (type) {
+	case hwmon_chip:
+		if (attr != hwmon_chip_update_interval)
+			return -EOPNOTSUPP;
+
+		kraken3_lock_control(priv);
+		ret = kraken3_set_update_interval(priv, val);
+		mutex_unlock(&priv->control_lock);
+		return ret;
+	case hwmon_pwm:
+		/* The external mode is applied right away, so read its temp before locking */
+		if (attr == hwmon_pwm_enable && val == 3)
+			kraken3_read_external_temps(priv, BIT(channel), &temps);
+
+		kraken3_lock_control(priv);
+		ret = kraken3_write_pwm(priv, attr, channel, val, &temps);
+		mutex_unlock(&priv->control_lock);
+		return ret;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+/* Like writing pwmN, so the cooling device only takes effect while the channel is in manual mode */
+static int kraken3_set_cooling_pwm(void *data, int channel, long val)
+{
+	struct kraken3_data *priv = data;
+	int ret;
+
+	kraken3_lock_control(priv);
+	ret = kraken3_write_pwm(priv, hwmon_pwm_input, channel, val, NULL);
+	mutex_unlock(&priv->control_lock);
+
+	return ret;
+}
+
 static ssize_t kraken3_fan_curve_pwm_store(struct device *dev, struct device_attribute *attr,
 					   const char *buf, size_t count)
 {
 	struct sensor_device_attribute_2 *dev_attr = to_sensor_dev_attr_2(attr);
 	struct kraken3_data *priv = dev_get_drvdata(dev);
+	unsigned int delay;
 	long val;
 	int ret;
 
@@ -501,17 +992,200 @@ static ssize_t kraken3_fan_curve_pwm_store(struct device *dev, struct device_att
 	if (val < 0)
 		return val;
 
+	kraken3_lock_control(priv);
+
 	priv->channel_info[dev_attr->nr].pwm_points[dev_attr->index] = val;
 
+	ret = 0;
 	if (priv->channel_info[dev_attr->nr].mode == curve) {
-		/* Apply the curve */
-		ret =
-		    kraken3_write_curve(priv,
-					priv->channel_info[dev_attr->nr].pwm_points, dev_attr->nr);
+		delay = READ_ONCE(curve_flush_delay);
+		if (delay) {
+			/* Merge with further point changes, see kraken3_curve_flush_work() */
+			set_bit(dev_attr->nr, &priv->curve_flush_pending);
+			mod_delayed_work(system_wq, &priv->curve_flush_work,
+					 msecs_to_jiffies(delay));
+		} else {
+			/* Apply the curve */
+			ret = kraken3_write_curve(priv,
+						  priv->channel_info[dev_attr->nr].pwm_points,
+						  dev_attr->nr);
+		}
+	}
+
+	mutex_unlock(&priv->control_lock);
+	if (ret < 0)
+		return ret;
+
+	return count;
+}
+
+static ssize_t kraken3_fan_curve_pwms_show(struct device *dev, struct device_attribute *attr,
+					   char *buf)
+{
+	struct sensor_device_attribute_2 *dev_attr = to_sensor_dev_attr_2(attr);
+	struct kraken3_data *priv = dev_get_drvdata(dev);
+	u8 *pwm_points = priv->channel_info[dev_attr->nr].pwm_points;
+	int i, len = 0;
+
+	kraken3_lock_control(priv);
+	for (i = 0; i < CUSTOM_CURVE_POINTS; i++)
+		len += sysfs_emit_at(buf, len, "%d%c", kraken3_percent_to_pwm(pwm_points[i]),
+				     i < CUSTOM_CURVE_POINTS - 1 ? ' ' : '\n');
+	mutex_unlock(&priv->control_lock);
+
+	return len;
+}
+
+/*
+ * Replaces the whole curve of a channel at once, so that it's uploaded (if in curve mode)
+ * only once. Expects CUSTOM_CURVE_POINTS PWM values, separated by whitespace.
+ */
+static ssize_t kraken3_fan_curve_pwms_store(struct device *dev, struct device_attribute *attr,
+					    const char *buf, size_t count)
+{
+	struct sensor_device_attribute_2 *dev_attr = to_sensor_dev_attr_2(attr);
+	struct kraken3_data *priv = dev_get_drvdata(dev);
+	u8 pwm_points[CUSTOM_CURVE_POINTS];
+	const char *pos = buf;
+	int i, len, ret;
+	long val;
+
+	for (i = 0; i < CUSTOM_CURVE_POINTS; i++) {
+		if (sscanf(pos, "%ld%n", &val, &len) != 1)
+			return -EINVAL;
+		pos += len;
+
+		ret = kraken3_pwm_to_percent(val, dev_attr->nr);
 		if (ret < 0)
 			return ret;
+
+		pwm_points[i] = ret;
+	}
+
+	/* Reject extra values */
+	if (*skip_spaces(pos))
+		return -EINVAL;
+
+	kraken3_lock_control(priv);
+
+	memcpy(priv->channel_info[dev_attr->nr].pwm_points, pwm_points, CUSTOM_CURVE_POINTS);
+
+	ret = 0;
+	if (priv->channel_info[dev_attr->nr].mode == curve) {
+		/* Apply the curve, superseding any pending flush */
+		clear_bit(dev_attr->nr, &priv->curve_flush_pending);
+		ret = kraken3_write_curve(priv, pwm_points, dev_attr->nr);
+	}
+
+	mutex_unlock(&priv->control_lock);
+	if (ret < 0)
+		return ret;
+
+	return count;
+}
+
+/* Uploads curves with point changes merged by kraken3_fan_curve_pwm_store() */
+static void kraken3_curve_flush_work(struct work_struct *work)
+{
+	struct kraken3_data *priv = container_of(to_delayed_work(work), struct kraken3_data,
+						 curve_flush_work);
+	int channel, ret;
+
+	kraken3_lock_control(priv);
+
+	for (channel = 0; channel < ARRAY_SIZE(priv->channel_info); channel++) {
+		if (!test_and_clear_bit(channel, &priv->curve_flush_pending))
+			continue;
+
+		/* The mode may have been changed in the meantime */
+		if (priv->channel_info[channel].mode != curve)
+			continue;
+
+		ret = kraken3_write_curve(priv, priv->channel_info[channel].pwm_points, channel);
+		if (ret < 0)
+			hid_err(priv->hdev, "curve upload for channel %d failed with %d\n",
+				channel, ret);
+	}
+
+	mutex_unlock(&priv->control_lock);
+}
+
+static ssize_t kraken3_temp_source_show(struct device *dev, struct device_attribute *attr,
+					char *buf)
+{
+	struct sensor_device_attribute_2 *dev_attr = to_sensor_dev_attr_2(attr);
+	struct kraken3_data *priv = dev_get_drvdata(dev);
+	ssize_t ret;
+
+	kraken3_lock_control(priv);
+	ret = sysfs_emit(buf, "%s\n", priv->channel_info[dev_attr->nr].temp_source);
+	mutex_unlock(&priv->control_lock);
+
+	return ret;
+}
+
+static ssize_t kraken3_temp_source_store(struct device *dev, struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct sensor_device_attribute_2 *dev_attr = to_sensor_dev_attr_2(attr);
+	struct kraken3_data *priv = dev_get_drvdata(dev);
+	struct kraken3_channel_info *info = &priv->channel_info[dev_attr->nr];
+	struct kraken3_external_temps temps;
+	char *name = temps.source[dev_attr->nr];
+	int ret = 0;
+
+	if (strscpy(name, buf, sizeof(temps.source[0])) < 0)
+		return -EINVAL;
+	strim(name);
+
+	/* Applied right away if in the external mode, so read the temp before locking */
+	kraken3_read_external_temp(&temps, dev_attr->nr);
+
+	kraken3_lock_control(priv);
+
+	/* The source can't be cleared while in use */
+	if (info->mode == external && !name[0]) {
+		ret = -EBUSY;
+		goto unlock;
 	}
 
+	strscpy(info->temp_source, name, sizeof(info->temp_source));
+	info->last_temp_valid = false;
+
+	if (info->mode == external)
+		ret = kraken3_apply_external(priv, dev_attr->nr, &temps);
+
+unlock:
+	mutex_unlock(&priv->control_lock);
+	if (ret < 0)
+		return ret;
+
+	return count;
+}
+
+static ssize_t kraken3_temp_hyst_show(struct device *dev, struct device_attribute *attr,
+				      char *buf)
+{
+	struct sensor_device_attribute_2 *dev_attr = to_sensor_dev_attr_2(attr);
+	struct kraken3_data *priv = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(priv->channel_info[dev_attr->nr].temp_hyst));
+}
+
+static ssize_t kraken3_temp_hyst_store(struct device *dev, struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct sensor_device_attribute_2 *dev_attr = to_sensor_dev_attr_2(attr);
+	struct kraken3_data *priv = dev_get_drvdata(dev);
+	int val;
+
+	if (kstrtoint(buf, 10, &val) < 0 || val < 0)
+		return -EINVAL;
+
+	kraken3_lock_control(priv);
+	priv->channel_info[dev_attr->nr].temp_hyst = val;
+	mutex_unlock(&priv->control_lock);
+
 	return count;
 }
 
@@ -520,9 +1194,10 @@ static umode_t kraken3_curve_props_are_visible(struct kobject *kobj, struct attr
 {
 	struct device *dev = kobj_to_dev(kobj);
 	struct kraken3_data *priv = dev_get_drvdata(dev);
+	struct device_attribute *dev_attr = container_of(attr, struct device_attribute, attr);
 
 	/* X53 does not have a fan */
-	if (index >= CUSTOM_CURVE_POINTS && priv->kind == X53)
+	if (to_sensor_dev_attr_2(dev_attr)->nr >= priv->model->channels)
 		return 0;
 
 	return attr->mode;
@@ -612,6 +1287,10 @@ static SENSOR_DEVICE_ATTR_2_WO(temp2_auto_point38_pwm, kraken3_fan_curve_pwm, 1,
 static SENSOR_DEVICE_ATTR_2_WO(temp2_auto_point39_pwm, kraken3_fan_curve_pwm, 1, 38);
 static SENSOR_DEVICE_ATTR_2_WO(temp2_auto_point40_pwm, kraken3_fan_curve_pwm, 1, 39);
 
+/* Whole pump and fan curves */
+static SENSOR_DEVICE_ATTR_2_RW(temp1_auto_point_pwm, kraken3_fan_curve_pwms, 0, 0);
+static SENSOR_DEVICE_ATTR_2_RW(temp2_auto_point_pwm, kraken3_fan_curve_pwms, 1, 0);
+
 static struct attribute *kraken3_curve_attrs[] = {
 	/* Pump control curve */
 	&sensor_dev_attr_temp1_auto_point1_pwm.dev_attr.attr,
@@ -695,6 +1374,9 @@ static struct attribute *kraken3_curve_attrs[] = {
 	&sensor_dev_attr_temp2_auto_point38_pwm.dev_attr.attr,
 	&sensor_dev_attr_temp2_auto_point39_pwm.dev_attr.attr,
 	&sensor_dev_attr_temp2_auto_point40_pwm.dev_attr.attr,
+	/* Whole curves */
+	&sensor_dev_attr_temp1_auto_point_pwm.dev_attr.attr,
+	&sensor_dev_attr_temp2_auto_point_pwm.dev_attr.attr,
 	NULL
 };
 
@@ -703,8 +1385,28 @@ static const struct attribute_group kraken3_curves_group = {
 	.is_visible = kraken3_curve_props_are_visible
 };
 
+/* Settings of the external mode */
+static SENSOR_DEVICE_ATTR_2_RW(pwm1_temp_source, kraken3_temp_source, 0, 0);
+static SENSOR_DEVICE_ATTR_2_RW(pwm2_temp_source, kraken3_temp_source, 1, 0);
+static SENSOR_DEVICE_ATTR_2_RW(pwm1_temp_hyst, kraken3_temp_hyst, 0, 0);
+static SENSOR_DEVICE_ATTR_2_RW(pwm2_temp_hyst, kraken3_temp_hyst, 1, 0);
+
+static struct attribute *kraken3_external_attrs[] = {
+	&sensor_dev_attr_pwm1_temp_source.dev_attr.attr,
+	&sensor_dev_attr_pwm2_temp_source.dev_attr.attr,
+	&sensor_dev_attr_pwm1_temp_hyst.dev_attr.attr,
+	&sensor_dev_attr_pwm2_temp_hyst.dev_attr.attr,
+	NULL
+};
+
+static const struct attribute_group kraken3_external_group = {
+	.attrs = kraken3_external_attrs,
+	.is_visible = kraken3_curve_props_are_visible
+};
+
 static const struct attribute_group *kraken3_groups[] = {
 	&kraken3_curves_group,
+	&kraken3_external_group,
 	NULL
 };
 
@@ -726,6 +1428,7 @@ static const struct hwmon_channel_info *kraken3_info[] = {
 	HWMON_CHANNEL_INFO(pwm,
 			   HWMON_PWM_INPUT | HWMON_PWM_ENABLE,
 			   HWMON_PWM_INPUT | HWMON_PWM_ENABLE),
+	HWMON_CHANNEL_INFO(chip, HWMON_C_UPDATE_INTERVAL),
 	NULL
 };
 
@@ -734,72 +1437,147 @@ static const struct hwmon_chip_info kraken3_chip_info = {
 	.info = kraken3_info,
 };
 
-static int kraken3_raw_event(struct hid_device *hdev, struct hid_report *report, u8 *data, int size)
+/*
+ * Marks the Z53 status request in flight, if any, as answered.
+ *
+ * Caller must hold priv->status_completion_lock.
+ */
+static void kraken3_end_status_request(struct kraken3_data *priv)
+{
+	s64 latency;
+
+	if (!priv->status_request_pending)
+		return;
+
+	latency = ktime_us_delta(ktime_get(), priv->status_request_sent);
+	nzxt_hid_hist_add(priv->stats.reply_latency, latency);
+	trace_nzxt_hid_status_complete(priv->hdev, 0, latency);
+	priv->status_request_pending = false;
+}
+
+static void kraken3_handle_fw_version_report(struct kraken3_data *priv, u8 *data)
 {
-	struct kraken3_data *priv = hid_get_drvdata(hdev);
 	int i;
 
-	if (size < MIN_REPORT_LENGTH)
-		return 0;
+	for (i = 0; i < 3; i++)
+		priv->firmware_version[i] = data[FIRMWARE_VERSION_OFFSET + i];
+
+	if (!completion_done(&priv->fw_version_processed))
+		complete_all(&priv->fw_version_processed);
+}
+
+/*
+ * Decodes a status report without touching any state. Returns false, leaving status as is,
+ * if the device reports being faulty.
+ */
+static bool kraken3_decode_status(const u8 *data, const struct kraken3_model *model,
+				  struct kraken3_status *status)
+{
+	int i;
 
-	if (report->id == FIRMWARE_REPORT_ID) {
-		/* Read firmware version */
-		for (i = 0; i < 3; i++)
-			priv->firmware_version[i] = data[FIRMWARE_VERSION_OFFSET + i];
+	if (data[TEMP_SENSOR_START_OFFSET] == 0xff && data[TEMP_SENSOR_END_OFFSET] == 0xff)
+		return false;
 
-		if (!completion_done(&priv->fw_version_processed))
-			complete_all(&priv->fw_version_processed);
+	*status = (struct kraken3_status) { };
 
-		return 0;
+	/* Temperature and fan sensor readings */
+	status->temp_input[0] =
+	    data[TEMP_SENSOR_START_OFFSET] * 1000 + data[TEMP_SENSOR_END_OFFSET] * 100;
+
+	for (i = 0; i < model->channels; i++) {
+		status->fan_input[i] = get_unaligned_le16(data + model->speed_offset[i]);
+		status->reported_duty[i] = kraken3_percent_to_pwm(data[model->duty_offset[i]]);
 	}
 
-	if (report->id != STATUS_REPORT_ID)
-		return 0;
+	return true;
+}
+
+static void kraken3_handle_status_report(struct kraken3_data *priv, u8 *data)
+{
+	const struct kraken3_model *model = priv->model;
+	struct kraken3_status status;
+	struct {
+		s32 values[3];
+		s64 timestamp __aligned(8);
+	} scan;
+	int i;
+
+	atomic_long_inc(&priv->stats.status_reports);
 
-	if (data[TEMP_SENSOR_START_OFFSET] == 0xff && data[TEMP_SENSOR_END_OFFSET] == 0xff) {
-		hid_err_once(hdev,
+	if (!kraken3_decode_status(data, model, &status)) {
+		hid_err_once(priv->hdev,
 			     "firmware or device is possibly damaged (is SATA power connected?), not parsing reports\n");
+		atomic_long_inc(&priv->stats.faulty_reports);
 
 		/*
 		 * Mark first X-series device report as received,
 		 * as well as all for Z-series, if faulty.
 		 */
 		spin_lock(&priv->status_completion_lock);
-		if (priv->kind != X53 || !completion_done(&priv->status_report_processed)) {
-			priv->is_device_faulty = true;
+		if (!model->pushes_status || !completion_done(&priv->status_report_processed)) {
+			write_seqcount_begin(&priv->status_seq);
+			priv->status.is_device_faulty = true;
+			write_seqcount_end(&priv->status_seq);
+
+			kraken3_end_status_request(priv);
 			complete_all(&priv->status_report_processed);
 		}
 		spin_unlock(&priv->status_completion_lock);
 
-		return 0;
+		return;
 	}
 
-	/* Received normal data */
-	priv->is_device_faulty = false;
+	status.updated = jiffies;
 
-	/* Temperature and fan sensor readings */
-	priv->temp_input[0] =
-	    data[TEMP_SENSOR_START_OFFSET] * 1000 + data[TEMP_SENSOR_END_OFFSET] * 100;
+	trace_nzxt_hid_sensor(priv->hdev, NZXT_HID_TEMP, 0, status.temp_input[0]);
+	for (i = 0; i < model->channels; i++) {
+		trace_nzxt_hid_sensor(priv->hdev, NZXT_HID_FAN, i, status.fan_input[i]);
+		trace_nzxt_hid_sensor(priv->hdev, NZXT_HID_DUTY, i, data[model->duty_offset[i]]);
+	}
 
-	priv->fan_input[0] = get_unaligned_le16(data + PUMP_SPEED_OFFSET);
-	priv->channel_info[0].reported_duty = kraken3_percent_to_pwm(data[PUMP_DUTY_OFFSET]);
+	/* The whole scan is copied into the buffer, padding included */
+	memset(&scan, 0, sizeof(scan));
+	scan.values[0] = status.temp_input[0];
+	scan.values[1] = status.fan_input[0];
+	scan.values[2] = status.fan_input[1];
+	nzxt_hid_iio_push(priv->iio_dev, scan.values);
 
 	spin_lock(&priv->status_completion_lock);
-	if (priv->kind == X53 && !completion_done(&priv->status_report_processed)) {
-		/* Mark first X-series device report as received */
+
+	write_seqcount_begin(&priv->status_seq);
+	priv->status = status;
+	write_seqcount_end(&priv->status_seq);
+
+	/*
+	 * Mark first X-series device report as received. For Z53 and KRAKEN2023, this wakes
+	 * up whoever requested the report.
+	 */
+	kraken3_end_status_request(priv);
+	if (!completion_done(&priv->status_report_processed))
 		complete_all(&priv->status_report_processed);
-	} else if (priv->kind == Z53 || priv->kind == KRAKEN2023) {
-		/* Additional readings for Z53 and KRAKEN2023 */
-		priv->fan_input[1] = get_unaligned_le16(data + Z53_FAN_SPEED_OFFSET);
-		priv->channel_info[1].reported_duty =
-		    kraken3_percent_to_pwm(data[Z53_FAN_DUTY_OFFSET]);
 
-		if (!completion_done(&priv->status_report_processed))
-			complete_all(&priv->status_report_processed);
-	}
 	spin_unlock(&priv->status_completion_lock);
 
-	priv->updated = jiffies;
+	nzxt_hid_notify(&priv->notify);
+}
+
+static int kraken3_raw_event(struct hid_device *hdev, struct hid_report *report, u8 *data, int size)
+{
+	trace_nzxt_hid_raw_event(hdev, report->id, size);
+
+	if (size < MIN_REPORT_LENGTH)
+		return 0;
+
+	switch (report->id) {
+	case FIRMWARE_REPORT_ID:
+		kraken3_handle_fw_version_report(hid_get_drvdata(hdev), data);
+		break;
+	case STATUS_REPORT_ID:
+		kraken3_handle_status_report(hid_get_drvdata(hdev), data);
+		break;
+	default:
+		break;
+	}
 
 	return 0;
 }
@@ -810,7 +1588,7 @@ static int kraken3_init_device(struct hid_device *hdev)
 	int ret;
 
 	/* Set the polling interval */
-	ret = kraken3_write_expanded(priv, set_interval_cmd, SET_INTERVAL_CMD_LENGTH);
+	ret = kraken3_set_update_interval(priv, priv->update_interval);
 	if (ret < 0)
 		return ret;
 
@@ -831,25 +1609,83 @@ static int kraken3_get_fw_ver(struct hid_device *hdev)
 	if (ret < 0)
 		return ret;
 
-	ret = wait_for_completion_interruptible_timeout(&priv->fw_version_processed,
-							msecs_to_jiffies(STATUS_VALIDITY));
-	if (ret == 0)
-		return -ETIMEDOUT;
-	else if (ret < 0)
-		return ret;
+	return nzxt_hid_wait_for_reply(&priv->out, &priv->fw_version_processed,
+				       msecs_to_jiffies(REPLY_TIMEOUT));
+}
 
-	return 0;
+/*
+ * Sends the state of a channel again, as kraken3_write_pwm() did when its mode was set. That's
+ * a single curve upload, and none for channels that were left to the device.
+ *
+ * Caller must hold priv->control_lock, and have read temps for the channels in the external mode.
+ */
+static int kraken3_restore_channel(struct kraken3_data *priv, int channel,
+				   const struct kraken3_external_temps *temps)
+{
+	struct kraken3_channel_info *info = &priv->channel_info[channel];
+
+	if (!info->mode_set)
+		return 0;
+
+	switch (info->mode) {
+	case off:
+		return kraken3_write_fixed_duty(priv, 255, channel);
+	case manual:
+		return kraken3_write_fixed_duty(priv, info->fixed_duty, channel);
+	case curve:
+		return kraken3_write_curve(priv, info->pwm_points, channel);
+	case external:
+		info->last_temp_valid = false;
+		return kraken3_apply_external(priv, channel, temps);
+	default:
+		return 0;
+	}
+}
+
+static void kraken3_resume_work(struct work_struct *work)
+{
+	struct kraken3_data *priv = container_of(work, struct kraken3_data, resume_work);
+	struct kraken3_external_temps temps;
+	int ret, channel;
+
+	kraken3_read_external_temps(priv, GENMASK(ARRAY_SIZE(temps.source) - 1, 0), &temps);
+
+	kraken3_lock_control(priv);
+
+	ret = kraken3_init_device(priv->hdev);
+	if (ret < 0) {
+		hid_err(priv->hdev, "req init (reset_resume) failed with %d\n", ret);
+		goto out;
+	}
+
+	for (channel = 0; channel < ARRAY_SIZE(priv->channel_info); channel++) {
+		ret = kraken3_restore_channel(priv, channel, &temps);
+		if (ret < 0)
+			hid_err(priv->hdev, "restoring channel %d failed with %d\n", channel, ret);
+	}
+
+out:
+	WRITE_ONCE(priv->resuming, false);
+	mutex_unlock(&priv->control_lock);
 }
 
+/*
+ * The device has lost whatever was sent to it before. Restoring it takes a few output reports,
+ * so it's left to kraken3_resume_work() instead of holding up the system resume.
+ */
 static int __maybe_unused kraken3_reset_resume(struct hid_device *hdev)
 {
-	int ret;
+	struct kraken3_data *priv = hid_get_drvdata(hdev);
+	int i;
 
-	ret = kraken3_init_device(hdev);
-	if (ret)
-		hid_err(hdev, "req init (reset_resume) failed with %d\n", ret);
+	kraken3_lock_control(priv);
+	for (i = 0; i < ARRAY_SIZE(priv->channel_info); i++)
+		priv->channel_info[i].sent_curve_valid = false;
+	WRITE_ONCE(priv->resuming, true);
+	mutex_unlock(&priv->control_lock);
 
-	return ret;
+	queue_work(system_long_wq, &priv->resume_work);
+	return 0;
 }
 
 static int firmware_version_show(struct seq_file *seqf, void *unused)
@@ -863,25 +1699,80 @@ static int firmware_version_show(struct seq_file *seqf, void *unused)
 }
 DEFINE_SHOW_ATTRIBUTE(firmware_version);
 
+static int stats_show(struct seq_file *seqf, void *unused)
+{
+	struct kraken3_data *priv = seqf->private;
+	struct kraken3_stats *stats = &priv->stats;
+
+	seq_printf(seqf, "status_reports: %lu\n", atomic_long_read(&stats->status_reports));
+	seq_printf(seqf, "faulty_reports: %lu\n", atomic_long_read(&stats->faulty_reports));
+	seq_printf(seqf, "requests_sent: %lu\n", atomic_long_read(&stats->requests_sent));
+	nzxt_hid_show_stats(seqf, &priv->out);
+
+	nzxt_hid_show_hist(seqf, "reply_latency_us", stats->reply_latency);
+	nzxt_hid_show_hist(seqf, "control_lock_wait_us", stats->control_lock_wait);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+static int age_show(struct seq_file *seqf, void *unused)
+{
+	struct kraken3_data *priv = seqf->private;
+	struct kraken3_status status;
+	char name[8];
+	int i;
+
+	kraken3_get_status(priv, &status);
+
+	/* All sensors come in the same report */
+	nzxt_hid_show_age(seqf, "temp1", status.updated);
+	for (i = 0; i < priv->model->channels; i++) {
+		scnprintf(name, sizeof(name), "fan%d", i + 1);
+		nzxt_hid_show_age(seqf, name, status.updated);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(age);
+
 static void kraken3_debugfs_init(struct kraken3_data *priv, const char *device_name)
 {
 	char name[64];
 
-	if (!priv->firmware_version[0])
-		return;		/* Nothing to display in debugfs */
-
 	scnprintf(name, sizeof(name), "%s_%s-%s", DRIVER_NAME, device_name,
 		  dev_name(&priv->hdev->dev));
 
 	priv->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_ulong("status_requests_coalesced", 0444, priv->debugfs,
+			     &priv->status_requests_coalesced);
+	debugfs_create_file("stats", 0444, priv->debugfs, priv, &stats_fops);
+	debugfs_create_file("age_ms", 0444, priv->debugfs, priv, &age_fops);
+	nzxt_hid_staleness_debugfs(priv->debugfs, &priv->staleness);
+}
+
+/*
+ * Waiting for the firmware version can take up to REPLY_TIMEOUT, so this is deferred from
+ * kraken3_probe(). The debugfs entry is created once the reply has arrived.
+ */
+static void kraken3_fw_version_work(struct work_struct *work)
+{
+	struct kraken3_data *priv = container_of(work, struct kraken3_data, fw_version_work);
+	int ret;
+
+	ret = kraken3_get_fw_ver(priv->hdev);
+	if (ret < 0) {
+		hid_warn(priv->hdev, "fw version request failed with %d\n", ret);
+		return;
+	}
+
 	debugfs_create_file("firmware_version", 0444, priv->debugfs, priv, &firmware_version_fops);
 }
 
 static int kraken3_probe(struct hid_device *hdev, const struct hid_device_id *id)
 {
 	struct kraken3_data *priv;
-	const char *device_name;
-	int ret;
+	int ret, i;
 
 	priv = devm_kzalloc(&hdev->dev, sizeof(*priv), GFP_KERNEL);
 	if (!priv)
@@ -890,12 +1781,14 @@ static int kraken3_probe(struct hid_device *hdev, const struct hid_device_id *id
 	priv->hdev = hdev;
 	hid_set_drvdata(hdev, priv);
 
+	priv->update_interval = UPDATE_INTERVAL_DEFAULT_MS;
+	priv->staleness.validity_ms = UPDATE_INTERVAL_DEFAULT_MS * STATUS_VALIDITY_REPORTS;
+
 	/*
-	 * Initialize ->updated to STATUS_VALIDITY seconds in the past, making
-	 * the initial empty data invalid for kraken3_read without the need for
-	 * a special case there.
+	 * Initialize ->status.updated far enough in the past, making the initial empty
+	 * data invalid for kraken3_read without the need for a special case there.
 	 */
-	priv->updated = jiffies - msecs_to_jiffies(STATUS_VALIDITY);
+	priv->status.updated = nzxt_hid_never_updated();
 
 	ret = hid_parse(hdev);
 	if (ret) {
@@ -916,39 +1809,27 @@ static int kraken3_probe(struct hid_device *hdev, const struct hid_device_id *id
 		goto fail_and_stop;
 	}
 
-	switch (hdev->product) {
-	case USB_PRODUCT_ID_X53:
-	case USB_PRODUCT_ID_X53_SECOND:
-		priv->kind = X53;
-		device_name = "x53";
-		break;
-	case USB_PRODUCT_ID_Z53:
-		priv->kind = Z53;
-		device_name = "z53";
-		break;
-	case USB_PRODUCT_ID_KRAKEN2023:
-		priv->kind = KRAKEN2023;
-		device_name = "kraken2023";
-		break;
-	case USB_PRODUCT_ID_KRAKEN2023_ELITE:
-		priv->kind = KRAKEN2023;
-		device_name = "kraken2023elite";
-		break;
-	default:
-		break;
-	}
+	priv->model = (const struct kraken3_model *)id->driver_data;
 
-	priv->buffer = devm_kzalloc(&hdev->dev, MAX_REPORT_LENGTH, GFP_KERNEL);
-	if (!priv->buffer) {
-		ret = -ENOMEM;
+	ret = nzxt_hid_out_init(&priv->out, hdev, MAX_REPORT_LENGTH, true);
+	if (ret)
 		goto fail_and_close;
-	}
 
-	mutex_init(&priv->buffer_lock);
-	mutex_init(&priv->z53_status_request_lock);
+	/* Only X53 devices stream reports; Z53 and KRAKEN2023 push the ones that were requested */
+	priv->iio_dev = nzxt_hid_iio_register(hdev, "kraken3", kraken3_iio_channels,
+					      ARRAY_SIZE(kraken3_iio_channels));
+
+	mutex_init(&priv->control_lock);
 	init_completion(&priv->fw_version_processed);
 	init_completion(&priv->status_report_processed);
 	spin_lock_init(&priv->status_completion_lock);
+	seqcount_spinlock_init(&priv->status_seq, &priv->status_completion_lock);
+	INIT_DELAYED_WORK(&priv->status_prefetch_work, kraken3_status_prefetch_work);
+	INIT_DELAYED_WORK(&priv->curve_flush_work, kraken3_curve_flush_work);
+	INIT_WORK(&priv->fw_version_work, kraken3_fw_version_work);
+	INIT_WORK(&priv->resume_work, kraken3_resume_work);
+	nzxt_hid_notify_init(&priv->notify, priv->model->notify_attrs);
+	INIT_DELAYED_WORK(&priv->external_work, kraken3_external_work);
 
 	hid_device_io_start(hdev);
 	ret = kraken3_init_device(hdev);
@@ -957,11 +1838,7 @@ static int kraken3_probe(struct hid_device *hdev, const struct hid_device_id *id
 		goto fail_and_close;
 	}
 
-	ret = kraken3_get_fw_ver(hdev);
-	if (ret < 0)
-		hid_warn(hdev, "fw version request failed with %d\n", ret);
-
-	priv->hwmon_dev = hwmon_device_register_with_info(&hdev->dev, device_name, priv,
+	priv->hwmon_dev = hwmon_device_register_with_info(&hdev->dev, priv->model->name, priv,
 							  &kraken3_chip_info, kraken3_groups);
 	if (IS_ERR(priv->hwmon_dev)) {
 		ret = PTR_ERR(priv->hwmon_dev);
@@ -969,7 +1846,18 @@ static int kraken3_probe(struct hid_device *hdev, const struct hid_device_id *id
 		goto fail_and_close;
 	}
 
-	kraken3_debugfs_init(priv, device_name);
+	nzxt_hid_notify_start(&priv->notify, priv->hwmon_dev);
+
+	for (i = 0; i < priv->model->channels; i++)
+		nzxt_hid_cooling_register(hdev, &priv->cooling[i], kraken3_cooling_type[i],
+					  kraken3_set_cooling_pwm, priv, i);
+
+	kraken3_debugfs_init(priv, priv->model->name);
+	queue_work(system_long_wq, &priv->fw_version_work);
+
+	/* X53 devices push status reports on their own */
+	if (!priv->model->pushes_status && status_prefetch_interval)
+		queue_delayed_work(system_freezable_wq, &priv->status_prefetch_work, 0);
 
 	return 0;
 
@@ -983,35 +1871,64 @@ fail_and_stop:
 static void kraken3_remove(struct hid_device *hdev)
 {
 	struct kraken3_data *priv = hid_get_drvdata(hdev);
+	int i;
 
-	debugfs_remove_recursive(priv->debugfs);
+	for (i = 0; i < ARRAY_SIZE(priv->cooling); i++)
+		nzxt_hid_cooling_unregister(&priv->cooling[i]);
+
+	nzxt_hid_notify_stop(&priv->notify);
+
+	/* Unregister first, so that the works can't be queued again through sysfs */
 	hwmon_device_unregister(priv->hwmon_dev);
 
+	cancel_delayed_work_sync(&priv->status_prefetch_work);
+	cancel_delayed_work_sync(&priv->curve_flush_work);
+	cancel_delayed_work_sync(&priv->external_work);
+	cancel_work_sync(&priv->fw_version_work);
+	cancel_work_sync(&priv->resume_work);
+
+	debugfs_remove_recursive(priv->debugfs);
+
 	hid_hw_close(hdev);
 	hid_hw_stop(hdev);
 }
 
 static const struct hid_device_id kraken3_table[] = {
 	/* NZXT Kraken X53/X63/X73 have two possible product IDs */
-	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_X53) },
-	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_X53_SECOND) },
-	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_Z53) },
-	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_KRAKEN2023) },
-	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_KRAKEN2023_ELITE) },
+	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_X53),
+	  .driver_data = (kernel_ulong_t)&kraken3_x53 },
+	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_X53_SECOND),
+	  .driver_data = (kernel_ulong_t)&kraken3_x53 },
+	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_Z53),
+	  .driver_data = (kernel_ulong_t)&kraken3_z53 },
+	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_KRAKEN2023),
+	  .driver_data = (kernel_ulong_t)&kraken3_2023 },
+	{ HID_USB_DEVICE(USB_VENDOR_ID_NZXT, USB_PRODUCT_ID_KRAKEN2023_ELITE),
+	  .driver_data = (kernel_ulong_t)&kraken3_2023_elite },
 	{ }
 };
 
 MODULE_DEVICE_TABLE(hid, kraken3_table);
 
+/* The HID core only matches report types here; report IDs are checked in kraken3_raw_event() */
+static const struct hid_report_id kraken3_report_table[] = {
+	{ HID_INPUT_REPORT },
+	{ HID_TERMINATOR }
+};
+
 static struct hid_driver kraken3_driver = {
 	.name = DRIVER_NAME,
 	.id_table = kraken3_table,
 	.probe = kraken3_probe,
 	.remove = kraken3_remove,
+	.report_table = kraken3_report_table,
 	.raw_event = kraken3_raw_event,
 #ifdef CONFIG_PM
 	.reset_resume = kraken3_reset_resume,
 #endif
+	.driver = {
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+	},
 };
 
 static int __init kraken3_init(void)
@@ -9,6 +9,7 @@
 
 #include <linux/hid.h>
 #include <linux/hwmon.h>
+#include <linux/jiffies.h>
 #if KERNEL_VERSION(5, 11, 0) <= LINUX_VERSION_CODE
 #include <linux/math.h>
 #else
@@ -16,8 +17,10 @@
 #endif
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/seqlock.h>
 #include <linux/spinlock.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <asm/byteorder.h>
 
@@ -27,6 +30,9 @@
 #include <asm/unaligned.h>
 #endif
 
+#include "nzxt-hid-common.h"
+#include "nzxt-hid-trace.h"
+
 /*
  * The device has only 3 fan channels/connectors. But all HID reports have
  * space reserved for up to 8 channels.
@@ -36,6 +42,25 @@
 
 #define UPDATE_INTERVAL_DEFAULT_MS 1000
 
+static unsigned int pwm_commit_delay;
+module_param(pwm_commit_delay, uint, 0644);
+MODULE_PARM_DESC(pwm_commit_delay,
+		 "Delay in ms for merging pwm changes into one report (0 to disable)");
+
+static unsigned int idle_timeout;
+module_param(idle_timeout, uint, 0444);
+MODULE_PARM_DESC(idle_timeout,
+		 "Seconds without reads before switching to idle_update_interval (0 to disable)");
+
+static unsigned int idle_update_interval = 8000;
+module_param(idle_update_interval, uint, 0644);
+MODULE_PARM_DESC(idle_update_interval, "Update interval in ms while idle (default 8000)");
+
+static bool fast_resume;
+module_param(fast_resume, bool, 0644);
+MODULE_PARM_DESC(fast_resume,
+		 "Restore fan duties on resume instead of detecting the fans again");
+
 /* These strings match labels on the device exactly */
 static const char *const fan_label[] = {
 	"FAN 1",
@@ -181,9 +206,22 @@ struct set_fan_speed_report {
 	u8 duty_percent[FAN_CHANNELS_MAX];
 } __packed;
 
+/* Speed, current and voltage of each channel, in order */
+#define SMART2_IIO_CHANNEL(ch)						\
+	NZXT_HID_IIO_CHAN(IIO_ANGL_VEL, ch, 3 * (ch)),			\
+	NZXT_HID_IIO_CHAN(IIO_CURRENT, ch, 3 * (ch) + 1),		\
+	NZXT_HID_IIO_CHAN(IIO_VOLTAGE, ch, 3 * (ch) + 2)
+
+static const struct iio_chan_spec nzxt_smart2_iio_channels[] = {
+	SMART2_IIO_CHANNEL(0), SMART2_IIO_CHANNEL(1), SMART2_IIO_CHANNEL(2),
+	IIO_CHAN_SOFT_TIMESTAMP(3 * FAN_CHANNELS),
+};
+
 struct drvdata {
 	struct hid_device *hid;
 	struct device *hwmon;
+	struct iio_dev *iio; /* optional */
+	struct nzxt_hid_cooling cooling[FAN_CHANNELS]; /* optional */
 
 	u8 fan_duty_percent[FAN_CHANNELS];
 	u16 fan_rpm[FAN_CHANNELS];
@@ -198,23 +236,53 @@ struct drvdata {
 
 	/*
 	 * wq is used to wait for *_received flags to become true.
-	 * All accesses to *_received flags and fan_* arrays are performed with
-	 * wq.lock held.
+	 * All changes to *_received flags and fan_* arrays are performed with
+	 * wq.lock held, inside a status_seq write section. Readers that find
+	 * the flag they need already set can read the data in a status_seq read
+	 * section instead of taking wq.lock.
 	 */
 	wait_queue_head_t wq;
+	seqcount_spinlock_t status_seq;
+	/* Number of status reports received, for waiting for a fresh one */
+	unsigned int status_count;
 	/*
 	 * mutex is used to:
 	 * 1) Prevent concurrent conflicting changes to update interval and pwm
 	 * values (after sending an output hid report, the corresponding field
 	 * in drvdata must be updated, and only then new output reports can be
 	 * sent).
-	 * 2) Synchronize access to output_buffer (well, the buffer is here,
-	 * because synchronization is necessary anyway - so why not get rid of
-	 * a kmalloc?).
+	 * 2) Order reports that depend on each other; out only serializes
+	 * individual reports.
 	 */
 	struct mutex mutex;
 	long update_interval;
-	u8 output_buffer[OUTPUT_REPORT_SIZE];
+	struct nzxt_hid_out out;
+
+	/*
+	 * pwm changes waiting for pwm_commit_work to send them together, after
+	 * pwm_commit_delay. Protected by mutex.
+	 */
+	struct delayed_work pwm_commit_work;
+	u8 pending_duty_percent[FAN_CHANNELS];
+	u8 pending_channel_mask;
+
+	/*
+	 * Last duties sent to the device, for fast_reset_resume() to restore.
+	 * fan_duty_percent can't be used for that, as status reports overwrite
+	 * it with the defaults of a device that was reset. Channels that were
+	 * never written are left at those defaults. Protected by mutex.
+	 */
+	u8 written_duty_percent[FAN_CHANNELS];
+	u8 written_channel_mask;
+
+	/*
+	 * With idle_timeout, idle_work switches the device to
+	 * idle_update_interval once there have been no reads for that long,
+	 * and the next read switches it back. idle is protected by mutex.
+	 */
+	struct delayed_work idle_work;
+	unsigned long last_read; /* jiffies */
+	bool idle;
 };
 
 static long scale_pwm_value(long val, long orig_max, long new_max)
@@ -229,35 +297,85 @@ static long scale_pwm_value(long val, long orig_max, long new_max)
 	return max(1L, DIV_ROUND_CLOSEST(min(val, orig_max) * new_max, orig_max));
 }
 
-static void handle_fan_config_report(struct drvdata *drvdata, void *data, int size)
+/*
+ * Pure decoders of the input reports, so that they run before taking wq.lock.
+ * decode_fan_config() returns false for reports without the expected magic.
+ */
+static bool decode_fan_config(const struct fan_config_report *report, u8 *fan_type)
 {
-	struct fan_config_report *report = data;
 	int i;
 
+	if (report->magic != 0x03)
+		return false;
+
+	for (i = 0; i < FAN_CHANNELS; i++)
+		fan_type[i] = report->fan_type[i];
+
+	return true;
+}
+
+static void handle_fan_config_report(struct drvdata *drvdata, void *data, int size)
+{
+	u8 fan_type[FAN_CHANNELS];
+
 	if (size < sizeof(struct fan_config_report))
 		return;
 
-	if (report->magic != 0x03)
+	if (!decode_fan_config(data, fan_type))
 		return;
 
 	spin_lock(&drvdata->wq.lock);
+	write_seqcount_begin(&drvdata->status_seq);
 
-	for (i = 0; i < FAN_CHANNELS; i++)
-		drvdata->fan_type[i] = report->fan_type[i];
-
+	memcpy(drvdata->fan_type, fan_type, sizeof(fan_type));
 	drvdata->fan_config_received = true;
+
+	write_seqcount_end(&drvdata->status_seq);
 	wake_up_all_locked(&drvdata->wq);
 	spin_unlock(&drvdata->wq.lock);
 }
 
+static void decode_fan_speed(const struct fan_status_report *report,
+			     u16 *fan_rpm, u8 *duty_percent)
+{
+	int i;
+
+	for (i = 0; i < FAN_CHANNELS; i++) {
+		fan_rpm[i] = get_unaligned_le16(&report->fan_speed.fan_rpm[i]);
+		duty_percent[i] = report->fan_speed.duty_percent[i];
+	}
+}
+
+static void decode_fan_voltage(const struct fan_status_report *report,
+			       u16 *fan_in, u16 *fan_curr)
+{
+	int i;
+
+	for (i = 0; i < FAN_CHANNELS; i++) {
+		fan_in[i] = get_unaligned_le16(&report->fan_voltage.fan_in[i]);
+		fan_curr[i] = get_unaligned_le16(&report->fan_voltage.fan_current[i]);
+	}
+}
+
 static void handle_fan_status_report(struct drvdata *drvdata, void *data, int size)
 {
 	struct fan_status_report *report = data;
+	u16 fan_rpm[FAN_CHANNELS], fan_in[FAN_CHANNELS], fan_curr[FAN_CHANNELS];
+	u8 duty_percent[FAN_CHANNELS];
+	struct {
+		s32 values[3 * FAN_CHANNELS];
+		s64 timestamp __aligned(8);
+	} scan;
 	int i;
 
 	if (size < sizeof(struct fan_status_report))
 		return;
 
+	if (report->type == FAN_STATUS_REPORT_SPEED)
+		decode_fan_speed(report, fan_rpm, duty_percent);
+	else if (report->type == FAN_STATUS_REPORT_VOLTAGE)
+		decode_fan_voltage(report, fan_in, fan_curr);
+
 	spin_lock(&drvdata->wq.lock);
 
 	/*
@@ -271,6 +389,8 @@ static void handle_fan_status_report(struct drvdata *drvdata, void *data, int si
 		return;
 	}
 
+	write_seqcount_begin(&drvdata->status_seq);
+
 	for (i = 0; i < FAN_CHANNELS; i++) {
 		if (drvdata->fan_type[i] == report->fan_type[i])
 			continue;
@@ -290,30 +410,44 @@ static void handle_fan_status_report(struct drvdata *drvdata, void *data, int si
 
 	switch (report->type) {
 	case FAN_STATUS_REPORT_SPEED:
+		memcpy(drvdata->fan_rpm, fan_rpm, sizeof(fan_rpm));
+		memcpy(drvdata->fan_duty_percent, duty_percent, sizeof(duty_percent));
+		drvdata->pwm_status_received = true;
+
 		for (i = 0; i < FAN_CHANNELS; i++) {
-			drvdata->fan_rpm[i] =
-				get_unaligned_le16(&report->fan_speed.fan_rpm[i]);
-			drvdata->fan_duty_percent[i] =
-				report->fan_speed.duty_percent[i];
+			trace_nzxt_hid_sensor(drvdata->hid, NZXT_HID_FAN, i, fan_rpm[i]);
+			trace_nzxt_hid_sensor(drvdata->hid, NZXT_HID_DUTY, i, duty_percent[i]);
 		}
-
-		drvdata->pwm_status_received = true;
-		wake_up_all_locked(&drvdata->wq);
 		break;
 
 	case FAN_STATUS_REPORT_VOLTAGE:
+		memcpy(drvdata->fan_in, fan_in, sizeof(fan_in));
+		memcpy(drvdata->fan_curr, fan_curr, sizeof(fan_curr));
+		drvdata->voltage_status_received = true;
+
 		for (i = 0; i < FAN_CHANNELS; i++) {
-			drvdata->fan_in[i] =
-				get_unaligned_le16(&report->fan_voltage.fan_in[i]);
-			drvdata->fan_curr[i] =
-				get_unaligned_le16(&report->fan_voltage.fan_current[i]);
+			trace_nzxt_hid_sensor(drvdata->hid, NZXT_HID_IN, i, fan_in[i]);
+			trace_nzxt_hid_sensor(drvdata->hid, NZXT_HID_CURR, i, fan_curr[i]);
 		}
-
-		drvdata->voltage_status_received = true;
-		wake_up_all_locked(&drvdata->wq);
 		break;
 	}
 
+	drvdata->status_count++;
+
+	/* Each report has only half of the data; push the last known rest too */
+	if (drvdata->iio) {
+		/* The whole scan is copied into the buffer, padding included */
+		memset(&scan, 0, sizeof(scan));
+		for (i = 0; i < FAN_CHANNELS; i++) {
+			scan.values[3 * i] = drvdata->fan_rpm[i];
+			scan.values[3 * i + 1] = drvdata->fan_curr[i];
+			scan.values[3 * i + 2] = drvdata->fan_in[i];
+		}
+		nzxt_hid_iio_push(drvdata->iio, scan.values);
+	}
+
+	write_seqcount_end(&drvdata->status_seq);
+	wake_up_all_locked(&drvdata->wq);
 	spin_unlock(&drvdata->wq.lock);
 }
 
@@ -346,109 +480,139 @@ static umode_t nzxt_smart2_hwmon_is_visible(const void *data,
 	}
 }
 
-static int nzxt_smart2_hwmon_read(struct device *dev, enum hwmon_sensor_types type,
-				  u32 attr, int channel, long *val)
+/*
+ * Returns the *_received flag that must be true before attr can be read, or
+ * NULL if attr can't be read.
+ *
+ * fancontrol:
+ * 1) remembers pwm* values when it starts
+ * 2) needs pwm*_enable to be 1 on controlled fans
+ * So make sure we have correct data before allowing pwm* reads.
+ * Returning errors for pwm of fan speed read can even cause
+ * fancontrol to shut down. So the wait is unavoidable.
+ *
+ * It's not strictly necessary to wait for *_received in the remaining
+ * cases (fancontrol doesn't care about them). But I'm doing it to have
+ * consistent behavior.
+ */
+static bool *status_received_flag(struct drvdata *drvdata,
+				  enum hwmon_sensor_types type, u32 attr)
 {
-	struct drvdata *drvdata = dev_get_drvdata(dev);
-	int res = -EINVAL;
-
-	if (type == hwmon_chip) {
+	switch (type) {
+	case hwmon_pwm:
 		switch (attr) {
-		case hwmon_chip_update_interval:
-			*val = drvdata->update_interval;
-			return 0;
+		case hwmon_pwm_enable:
+		case hwmon_pwm_mode:
+			return &drvdata->fan_config_received;
+
+		case hwmon_pwm_input:
+			return &drvdata->pwm_status_received;
 
 		default:
-			return -EINVAL;
+			return NULL;
 		}
-	}
 
-	spin_lock_irq(&drvdata->wq.lock);
+	case hwmon_fan:
+		if (attr == hwmon_fan_input)
+			return &drvdata->pwm_status_received;
+		return NULL;
+
+	case hwmon_in:
+		if (attr == hwmon_in_input)
+			return &drvdata->voltage_status_received;
+		return NULL;
+
+	case hwmon_curr:
+		if (attr == hwmon_curr_input)
+			return &drvdata->voltage_status_received;
+		return NULL;
+
+	default:
+		return NULL;
+	}
+}
 
+/*
+ * Caller must hold wq.lock or be in a status_seq read section, and the flag
+ * from status_received_flag() must be true.
+ */
+static long status_value(struct drvdata *drvdata, enum hwmon_sensor_types type,
+			 u32 attr, int channel)
+{
 	switch (type) {
 	case hwmon_pwm:
-		/*
-		 * fancontrol:
-		 * 1) remembers pwm* values when it starts
-		 * 2) needs pwm*_enable to be 1 on controlled fans
-		 * So make sure we have correct data before allowing pwm* reads.
-		 * Returning errors for pwm of fan speed read can even cause
-		 * fancontrol to shut down. So the wait is unavoidable.
-		 */
 		switch (attr) {
 		case hwmon_pwm_enable:
-			res = wait_event_interruptible_locked_irq(drvdata->wq,
-								  drvdata->fan_config_received);
-			if (res)
-				goto unlock;
-
-			*val = drvdata->fan_type[channel] != FAN_TYPE_NONE;
-			break;
+			return drvdata->fan_type[channel] != FAN_TYPE_NONE;
 
 		case hwmon_pwm_mode:
-			res = wait_event_interruptible_locked_irq(drvdata->wq,
-								  drvdata->fan_config_received);
-			if (res)
-				goto unlock;
-
-			*val = drvdata->fan_type[channel] == FAN_TYPE_PWM;
-			break;
-
-		case hwmon_pwm_input:
-			res = wait_event_interruptible_locked_irq(drvdata->wq,
-								  drvdata->pwm_status_received);
-			if (res)
-				goto unlock;
+			return drvdata->fan_type[channel] == FAN_TYPE_PWM;
 
-			*val = scale_pwm_value(drvdata->fan_duty_percent[channel],
+		default:
+			return scale_pwm_value(drvdata->fan_duty_percent[channel],
 					       100, 255);
-			break;
 		}
-		break;
 
 	case hwmon_fan:
-		/*
-		 * It's not strictly necessary to wait for *_received in the
-		 * remaining cases (fancontrol doesn't care about them). But I'm
-		 * doing it to have consistent behavior.
-		 */
-		if (attr == hwmon_fan_input) {
-			res = wait_event_interruptible_locked_irq(drvdata->wq,
-								  drvdata->pwm_status_received);
-			if (res)
-				goto unlock;
-
-			*val = drvdata->fan_rpm[channel];
-		}
-		break;
+		return drvdata->fan_rpm[channel];
 
 	case hwmon_in:
-		if (attr == hwmon_in_input) {
-			res = wait_event_interruptible_locked_irq(drvdata->wq,
-								  drvdata->voltage_status_received);
-			if (res)
-				goto unlock;
+		return drvdata->fan_in[channel];
 
-			*val = drvdata->fan_in[channel];
-		}
-		break;
+	default:
+		return drvdata->fan_curr[channel];
+	}
+}
 
-	case hwmon_curr:
-		if (attr == hwmon_curr_input) {
-			res = wait_event_interruptible_locked_irq(drvdata->wq,
-								  drvdata->voltage_status_received);
-			if (res)
-				goto unlock;
+static int nzxt_smart2_mark_active(struct drvdata *drvdata);
+
+static int nzxt_smart2_hwmon_read(struct device *dev, enum hwmon_sensor_types type,
+				  u32 attr, int channel, long *val)
+{
+	struct drvdata *drvdata = dev_get_drvdata(dev);
+	unsigned int seq;
+	bool *received;
+	bool ready;
+	int res;
 
-			*val = drvdata->fan_curr[channel];
+	if (type == hwmon_chip) {
+		switch (attr) {
+		case hwmon_chip_update_interval:
+			*val = drvdata->update_interval;
+			return 0;
+
+		default:
+			return -EINVAL;
 		}
-		break;
+	}
 
-	default:
-		break;
+	received = status_received_flag(drvdata, type, attr);
+	if (!received)
+		return -EINVAL;
+
+	if (idle_timeout) {
+		res = nzxt_smart2_mark_active(drvdata);
+		if (res)
+			return res;
 	}
 
-unlock:
+	/* Once the data has arrived, there's no need to take wq.lock */
+	do {
+		seq = read_seqcount_begin(&drvdata->status_seq);
+		ready = *received;
+		if (ready)
+			*val = status_value(drvdata, type, attr, channel);
+	} while (read_seqcount_retry(&drvdata->status_seq, seq));
+
+	if (ready)
+		return 0;
+
+	spin_lock_irq(&drvdata->wq.lock);
+
+	res = wait_event_interruptible_locked_irq(drvdata->wq, *received);
+	if (!res)
+		*val = status_value(drvdata, type, attr, channel);
+
 	spin_unlock_irq(&drvdata->wq.lock);
 	return res;
 }
@@ -456,41 +620,48 @@ unlock:
 static int send_output_report(struct drvdata *drvdata, const void *data,
 			      size_t data_size)
 {
-	int ret;
-
-	if (data_size > sizeof(drvdata->output_buffer))
-		return -EINVAL;
-
-	memcpy(drvdata->output_buffer, data, data_size);
-
-	if (data_size < sizeof(drvdata->output_buffer))
-		memset(drvdata->output_buffer + data_size, 0,
-		       sizeof(drvdata->output_buffer) - data_size);
-
-	ret = hid_hw_output_report(drvdata->hid, drvdata->output_buffer,
-				   sizeof(drvdata->output_buffer));
-	return ret < 0 ? ret : 0;
+	return nzxt_hid_send(&drvdata->out, data, data_size);
 }
 
-static int set_pwm(struct drvdata *drvdata, int channel, long val)
+static void fill_fan_speed_report(struct set_fan_speed_report *report,
+				  u8 channel_mask, const u8 *duty_percent)
 {
-	int ret;
-	u8 duty_percent = scale_pwm_value(val, 255, 100);
+	int i;
 
-	struct set_fan_speed_report report = {
+	*report = (struct set_fan_speed_report) {
 		.report_id = OUTPUT_REPORT_ID_SET_FAN_SPEED,
 		.magic = 1,
-		.channel_bit_mask = 1 << channel
+		.channel_bit_mask = channel_mask
 	};
 
-	ret = mutex_lock_interruptible(&drvdata->mutex);
-	if (ret)
-		return ret;
+	for (i = 0; i < FAN_CHANNELS; i++) {
+		if (channel_mask & BIT(i))
+			report->duty_percent[i] = duty_percent[i];
+	}
+}
+
+/*
+ * Sets the duty of every channel in channel_mask, in a single report.
+ *
+ * Caller must hold drvdata->mutex.
+ */
+static int send_fan_speed(struct drvdata *drvdata, u8 channel_mask,
+			  const u8 *duty_percent)
+{
+	struct set_fan_speed_report report;
+	int ret, i;
+
+	fill_fan_speed_report(&report, channel_mask, duty_percent);
 
-	report.duty_percent[channel] = duty_percent;
 	ret = send_output_report(drvdata, &report, sizeof(report));
 	if (ret)
-		goto unlock;
+		return ret;
+
+	for (i = 0; i < FAN_CHANNELS; i++) {
+		if (channel_mask & BIT(i))
+			drvdata->written_duty_percent[i] = duty_percent[i];
+	}
+	drvdata->written_channel_mask |= channel_mask;
 
 	/*
 	 * pwmconfig and fancontrol scripts expect pwm writes to take effect
@@ -504,14 +675,68 @@ static int set_pwm(struct drvdata *drvdata, int channel, long val)
 	 * fancontrol setting fan speed to 100% during shutdown.
 	 */
 	spin_lock_bh(&drvdata->wq.lock);
-	drvdata->fan_duty_percent[channel] = duty_percent;
+	write_seqcount_begin(&drvdata->status_seq);
+	for (i = 0; i < FAN_CHANNELS; i++) {
+		if (channel_mask & BIT(i))
+			drvdata->fan_duty_percent[i] = duty_percent[i];
+	}
+	write_seqcount_end(&drvdata->status_seq);
 	spin_unlock_bh(&drvdata->wq.lock);
 
-unlock:
+	return 0;
+}
+
+static void pwm_commit_work(struct work_struct *work)
+{
+	struct drvdata *drvdata = container_of(to_delayed_work(work),
+					       struct drvdata, pwm_commit_work);
+	int ret;
+
+	mutex_lock(&drvdata->mutex);
+
+	if (drvdata->pending_channel_mask) {
+		ret = send_fan_speed(drvdata, drvdata->pending_channel_mask,
+				     drvdata->pending_duty_percent);
+		if (ret)
+			hid_warn(drvdata->hid, "pwm commit failed with %d\n", ret);
+
+		drvdata->pending_channel_mask = 0;
+	}
+
+	mutex_unlock(&drvdata->mutex);
+}
+
+static int set_pwm(struct drvdata *drvdata, int channel, long val)
+{
+	unsigned int delay = READ_ONCE(pwm_commit_delay);
+	int ret;
+
+	ret = mutex_lock_interruptible(&drvdata->mutex);
+	if (ret)
+		return ret;
+
+	drvdata->pending_duty_percent[channel] = scale_pwm_value(val, 255, 100);
+
+	if (delay) {
+		/* Merge with changes to other channels, see pwm_commit_work() */
+		drvdata->pending_channel_mask |= BIT(channel);
+		mod_delayed_work(system_wq, &drvdata->pwm_commit_work,
+				 msecs_to_jiffies(delay));
+	} else {
+		ret = send_fan_speed(drvdata, BIT(channel),
+				     drvdata->pending_duty_percent);
+		drvdata->pending_channel_mask &= ~BIT(channel);
+	}
+
 	mutex_unlock(&drvdata->mutex);
 	return ret;
 }
 
+static int set_cooling_pwm(void *data, int channel, long val)
+{
+	return set_pwm(data, channel, val);
+}
+
 /*
  * Workaround for fancontrol/pwmconfig trying to write to pwm*_enable even if it
  * already is 1 and read-only. Otherwise, fancontrol won't restore pwm on
@@ -538,39 +763,10 @@ static int set_pwm_enable(struct drvdata *drvdata, int channel, long val)
 	return (val == expected_val) ? 0 : -EOPNOTSUPP;
 }
 
-/*
- * Control byte	| Actual update interval in seconds
- * 0xff		| 65.5
- * 0xf7		| 63.46
- * 0x7f		| 32.74
- * 0x3f		| 16.36
- * 0x1f		| 8.17
- * 0x0f		| 4.07
- * 0x07		| 2.02
- * 0x03		| 1.00
- * 0x02		| 0.744
- * 0x01		| 0.488
- * 0x00		| 0.25
- */
-static u8 update_interval_to_control_byte(long interval)
+/* Returns the control byte that was sent, or an error */
+static int send_update_interval(struct drvdata *drvdata, long val)
 {
-	if (interval <= 250)
-		return 0;
-
-	return clamp_val(1 + DIV_ROUND_CLOSEST(interval - 488, 256), 0, 255);
-}
-
-static long control_byte_to_update_interval(u8 control_byte)
-{
-	if (control_byte == 0)
-		return 250;
-
-	return 488 + (control_byte - 1) * 256;
-}
-
-static int set_update_interval(struct drvdata *drvdata, long val)
-{
-	u8 control = update_interval_to_control_byte(val);
+	u8 control = nzxt_hid_interval_to_byte(val);
 	u8 report[] = {
 		OUTPUT_REPORT_ID_INIT_COMMAND,
 		INIT_COMMAND_SET_UPDATE_INTERVAL,
@@ -587,7 +783,106 @@ static int set_update_interval(struct drvdata *drvdata, long val)
 	if (ret)
 		return ret;
 
-	drvdata->update_interval = control_byte_to_update_interval(control);
+	return control;
+}
+
+static int set_update_interval(struct drvdata *drvdata, long val)
+{
+	int ret;
+
+	ret = send_update_interval(drvdata, val);
+	if (ret < 0)
+		return ret;
+
+	drvdata->update_interval = nzxt_hid_byte_to_interval(ret);
+
+	/* Configuring the interval ends the idle state as well */
+	WRITE_ONCE(drvdata->idle, false);
+	if (idle_timeout) {
+		WRITE_ONCE(drvdata->last_read, jiffies);
+		mod_delayed_work(system_freezable_wq, &drvdata->idle_work,
+				 idle_timeout * HZ);
+	}
+
+	return 0;
+}
+
+static void idle_work(struct work_struct *work)
+{
+	struct drvdata *drvdata = container_of(to_delayed_work(work),
+					       struct drvdata, idle_work);
+	unsigned long timeout = idle_timeout * HZ;
+	unsigned long deadline;
+	int ret;
+
+	mutex_lock(&drvdata->mutex);
+
+	/* Already idle, nzxt_smart2_mark_active() requeues this */
+	if (drvdata->idle)
+		goto unlock;
+
+	deadline = READ_ONCE(drvdata->last_read) + timeout;
+	if (time_before(jiffies, deadline)) {
+		queue_delayed_work(system_freezable_wq, &drvdata->idle_work,
+				   deadline - jiffies);
+		goto unlock;
+	}
+
+	ret = send_update_interval(drvdata, READ_ONCE(idle_update_interval));
+	if (ret < 0) {
+		hid_warn(drvdata->hid, "idle update interval failed with %d\n", ret);
+		queue_delayed_work(system_freezable_wq, &drvdata->idle_work, timeout);
+		goto unlock;
+	}
+
+	WRITE_ONCE(drvdata->idle, true);
+
+unlock:
+	mutex_unlock(&drvdata->mutex);
+}
+
+/*
+ * Records a read, switching the device back to the configured update interval
+ * if it was idle. In that case, waits up to one such interval for a fresh
+ * status report, so that the read is not served data from the slow interval.
+ */
+static int nzxt_smart2_mark_active(struct drvdata *drvdata)
+{
+	unsigned int count;
+	long timeout;
+	int ret;
+
+	WRITE_ONCE(drvdata->last_read, jiffies);
+
+	if (!READ_ONCE(drvdata->idle))
+		return 0;
+
+	ret = mutex_lock_interruptible(&drvdata->mutex);
+	if (ret)
+		return ret;
+
+	/* Someone else could have woken the device in the meantime */
+	if (!drvdata->idle) {
+		mutex_unlock(&drvdata->mutex);
+		return 0;
+	}
+
+	count = READ_ONCE(drvdata->status_count);
+	timeout = msecs_to_jiffies(drvdata->update_interval);
+
+	ret = set_update_interval(drvdata, drvdata->update_interval);
+
+	mutex_unlock(&drvdata->mutex);
+	if (ret)
+		return ret;
+
+	timeout = wait_event_interruptible_timeout(drvdata->wq,
+						   READ_ONCE(drvdata->status_count) != count,
+						   timeout);
+	if (timeout < 0)
+		return timeout;
+
+	/* If no report arrived in time, the last known data is still served */
 	return 0;
 }
 
@@ -699,36 +994,79 @@ static const struct hwmon_chip_info nzxt_smart2_chip_info = {
 static int nzxt_smart2_hid_raw_event(struct hid_device *hdev,
 				     struct hid_report *report, u8 *data, int size)
 {
-	struct drvdata *drvdata = hid_get_drvdata(hdev);
 	u8 report_id = *data;
 
+	trace_nzxt_hid_raw_event(hdev, report_id, size);
+
 	switch (report_id) {
 	case INPUT_REPORT_ID_FAN_CONFIG:
-		handle_fan_config_report(drvdata, data, size);
+		handle_fan_config_report(hid_get_drvdata(hdev), data, size);
 		break;
 
 	case INPUT_REPORT_ID_FAN_STATUS:
-		handle_fan_status_report(drvdata, data, size);
+		handle_fan_status_report(hid_get_drvdata(hdev), data, size);
 		break;
 	}
 
 	return 0;
 }
 
+/*
+ * Resumes without detecting the fans again, which would reset their duties and
+ * make readers wait for it to complete. The fan types detected before suspend
+ * are kept, and the duties last written are sent back in a single report. Both
+ * are done under drvdata->mutex, like every other duty change, so that they
+ * can't overtake a newer one. Reads are served the data from before suspend
+ * until new reports arrive.
+ */
+static int fast_reset_resume(struct drvdata *drvdata)
+{
+	int ret;
+
+	mutex_lock(&drvdata->mutex);
+
+	ret = set_update_interval(drvdata, drvdata->update_interval);
+	if (ret || !drvdata->written_channel_mask)
+		goto unlock;
+
+	ret = send_fan_speed(drvdata, drvdata->written_channel_mask,
+			     drvdata->written_duty_percent);
+
+unlock:
+	mutex_unlock(&drvdata->mutex);
+	return ret;
+}
+
 static int __maybe_unused nzxt_smart2_hid_reset_resume(struct hid_device *hdev)
 {
 	struct drvdata *drvdata = hid_get_drvdata(hdev);
+	bool detected;
+
+	/* Nothing to restore if the fans were never detected */
+	spin_lock_bh(&drvdata->wq.lock);
+	detected = drvdata->fan_config_received && drvdata->pwm_status_received;
+	spin_unlock_bh(&drvdata->wq.lock);
+
+	if (READ_ONCE(fast_resume) && detected)
+		return fast_reset_resume(drvdata);
 
 	/*
 	 * Userspace is still frozen (so no concurrent sysfs attribute access
 	 * is possible), but raw_event can already be called concurrently.
 	 */
 	spin_lock_bh(&drvdata->wq.lock);
+	write_seqcount_begin(&drvdata->status_seq);
 	drvdata->fan_config_received = false;
 	drvdata->pwm_status_received = false;
 	drvdata->voltage_status_received = false;
+	write_seqcount_end(&drvdata->status_seq);
 	spin_unlock_bh(&drvdata->wq.lock);
 
+	/* Detecting the fans resets their duties to the defaults */
+	mutex_lock(&drvdata->mutex);
+	drvdata->written_channel_mask = 0;
+	mutex_unlock(&drvdata->mutex);
+
 	return init_device(drvdata, drvdata->update_interval);
 }
 
@@ -741,7 +1079,7 @@ static int nzxt_smart2_hid_probe(struct hid_device *hdev,
 				 const struct hid_device_id *id)
 {
 	struct drvdata *drvdata;
-	int ret;
+	int i, ret;
 
 	drvdata = devm_kzalloc(&hdev->dev, sizeof(struct drvdata), GFP_KERNEL);
 	if (!drvdata)
@@ -751,12 +1089,23 @@ static int nzxt_smart2_hid_probe(struct hid_device *hdev,
 	hid_set_drvdata(hdev, drvdata);
 
 	init_waitqueue_head(&drvdata->wq);
+	INIT_DELAYED_WORK(&drvdata->idle_work, idle_work);
+	INIT_DELAYED_WORK(&drvdata->pwm_commit_work, pwm_commit_work);
+	seqcount_spinlock_init(&drvdata->status_seq, &drvdata->wq.lock);
 
 	mutex_init(&drvdata->mutex);
 	ret = devm_add_action_or_reset(&hdev->dev, mutex_fini, &drvdata->mutex);
 	if (ret)
 		return ret;
 
+	ret = nzxt_hid_out_init(&drvdata->out, hdev, OUTPUT_REPORT_SIZE, true);
+	if (ret)
+		return ret;
+
+	drvdata->iio = nzxt_hid_iio_register(hdev, "nzxtsmart2",
+					     nzxt_smart2_iio_channels,
+					     ARRAY_SIZE(nzxt_smart2_iio_channels));
+
 	ret = hid_parse(hdev);
 	if (ret)
 		return ret;
@@ -781,9 +1130,15 @@ static int nzxt_smart2_hid_probe(struct hid_device *hdev,
 		goto out_hw_close;
 	}
 
+	for (i = 0; i < FAN_CHANNELS; i++)
+		nzxt_hid_cooling_register(hdev, &drvdata->cooling[i],
+					  "nzxt-smart2-fan", set_cooling_pwm,
+					  drvdata, i);
+
 	return 0;
 
 out_hw_close:
+	cancel_delayed_work_sync(&drvdata->idle_work);
 	hid_hw_close(hdev);
 
 out_hw_stop:
@@ -794,8 +1149,15 @@ out_hw_stop:
 static void nzxt_smart2_hid_remove(struct hid_device *hdev)
 {
 	struct drvdata *drvdata = hid_get_drvdata(hdev);
+	int i;
+
+	for (i = 0; i < FAN_CHANNELS; i++)
+		nzxt_hid_cooling_unregister(&drvdata->cooling[i]);
 
 	hwmon_device_unregister(drvdata->hwmon);
+	/* Nothing can set pwm anymore; send what is still waiting to be merged */
+	flush_delayed_work(&drvdata->pwm_commit_work);
+	cancel_delayed_work_sync(&drvdata->idle_work);
 
 	hid_hw_close(hdev);
 	hid_hw_stop(hdev);
@@ -814,11 +1176,21 @@ static const struct hid_device_id nzxt_smart2_hid_id_table[] = {
 	{},
 };
 
+/*
+ * The HID core only matches report types here; report IDs are checked in
+ * nzxt_smart2_hid_raw_event().
+ */
+static const struct hid_report_id nzxt_smart2_hid_report_table[] = {
+	{ HID_INPUT_REPORT },
+	{ HID_TERMINATOR }
+};
+
 static struct hid_driver nzxt_smart2_hid_driver = {
 	.name = "nzxt-smart2",
 	.id_table = nzxt_smart2_hid_id_table,
 	.probe = nzxt_smart2_hid_probe,
 	.remove = nzxt_smart2_hid_remove,
+	.report_table = nzxt_smart2_hid_report_table,
 	.raw_event = nzxt_smart2_hid_raw_event,
 #ifdef CONFIG_PM
 	.reset_resume = nzxt_smart2_hid_reset_resume,
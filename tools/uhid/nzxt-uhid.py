@@ -0,0 +1,425 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+"""Emulate NZXT devices through /dev/uhid and benchmark the drivers against them.
+
+Creates a virtual HID device with the VID/PID of a real one, so that the
+matching liquidtux driver binds to it, and feeds it status reports.  Devices
+that stream their status do so at --rate reports per second; those that only
+reply to status requests (Kraken Z53 and 2023) reply to each one.  The reports
+are synthesized, or replayed in a loop from a recording with --replay.
+
+Recordings are text files with one input report per line, in hex and starting
+with the report ID, like the output of `usbhid-dump` with the headers removed.
+Blank lines and lines starting with '#' are ignored.
+
+Benchmarks (run once the driver has bound and registered its hwmon device):
+
+  --bench read        latency of single reads of --attr
+  --bench concurrent  reads/s of --attr with --readers concurrent readers
+  --bench write       time from writing --pwm-attr to the device receiving it
+
+Without --bench, the device is kept around until interrupted, which is useful
+to try the drivers in a VM without any hardware.  Needs root, and the uhid and
+liquidtux modules to be loaded.
+
+Example:
+  $ sudo ./nzxt-uhid.py kraken-z53 --bench concurrent --readers 8
+"""
+
+import argparse
+import glob
+import os
+import statistics
+import struct
+import sys
+import threading
+import time
+
+# From include/uapi/linux/uhid.h
+UHID_DESTROY = 1
+UHID_START = 2
+UHID_OUTPUT = 6
+UHID_CREATE2 = 11
+UHID_INPUT2 = 12
+UHID_DATA_MAX = 4096
+UHID_EVENT_SIZE = 4 + 128 + 64 + 64 + 2 + 2 + 4 * 4 + UHID_DATA_MAX
+
+BUS_USB = 0x03
+VID_NZXT = 0x1e71
+
+DOC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..',
+                       'Documentation', 'internal')
+
+
+def vendor_rdesc(inputs, outputs, size=64):
+    """Vendor-defined report descriptor with the given report IDs, all of size bytes."""
+    rdesc = [0x06, 0x00, 0xff, 0x09, 0x01, 0xa1, 0x01]
+    for ids, main in ((inputs, 0x81), (outputs, 0x91)):
+        for usage, report_id in enumerate(ids, 1):
+            rdesc += [0x85, report_id, 0x09, usage, 0x15, 0x00, 0x26, 0xff, 0x00,
+                      0x75, 0x08, 0x95, size - 1, main, 0x02]
+    return bytes(rdesc + [0xc0])
+
+
+def captured_rdesc(name):
+    """Report descriptor dumped from a real device, in Documentation/internal."""
+    with open(os.path.join(DOC_DIR, name + '.rdesc')) as f:
+        return bytes.fromhex(f.readline())
+
+
+class Device:
+    """Base emulated device; subclasses build reports and answer output reports."""
+
+    pid = None
+    rdesc = None
+    streams = True      # Whether status reports are sent without being requested
+    pwm_report = None   # Prefix of the output reports that set a duty
+
+    def __init__(self):
+        self.count = 0
+
+    def status(self):
+        """Synthesized status reports for one update interval."""
+        raise NotImplementedError
+
+    def reply(self, data, status):
+        """Input reports to send in response to the output report in data.
+
+        status returns the next status reports, synthesized or replayed.
+        """
+        return []
+
+
+class Kraken2(Device):
+    pid = 0x170e
+    rdesc = property(lambda self: captured_rdesc('1e71:170e'))
+
+    def status(self):
+        self.count += 1
+        rpm = 1500 + self.count % 20
+        return [bytes([0x04, 30, 5]) + struct.pack('>HH', rpm, 2000 + self.count % 20)
+                + bytes(10)]
+
+
+class Grid3(Device):
+    """Smart Device (V1), with three fan channels."""
+
+    pid = 0x1714
+    rdesc = property(lambda self: captured_rdesc('1e71:1714'))
+    pwm_report = bytes([0x02, 0x4d])
+    channels = 3
+
+    def status(self):
+        self.count += 1
+        reports = []
+        for channel in range(self.channels):
+            report = bytearray(21)
+            report[0] = 0x04
+            struct.pack_into('>H', report, 3, 1000 + 100 * channel + self.count % 20)
+            report[7:9] = bytes([12, 0])        # 12.00 V
+            report[9:11] = bytes([0, 15])       # 0.15 A
+            report[15] = channel << 4 | 0x2     # PWM fan
+            reports.append(bytes(report))
+        return reports
+
+
+class GridPlus3(Grid3):
+    """Grid+ V3, with six fan channels.
+
+    There is no capture of its report descriptor; it uses the same reports as
+    the Smart Device, so the descriptor of the latter is used.
+    """
+
+    pid = 0x1711
+    channels = 6
+
+
+class Kraken3(Device):
+    pid = 0x2007
+    rdesc = vendor_rdesc([0x75, 0x11], [0x70, 0x72, 0x74, 0x10])
+    pwm_report = bytes([0x72])
+
+    def status(self):
+        self.count += 1
+        report = bytearray(64)
+        report[0] = 0x75
+        report[15:17] = bytes([31, 4])          # 31.4 C
+        struct.pack_into('<H', report, 17, 2200 + self.count % 20)
+        report[19] = 60
+        struct.pack_into('<H', report, 23, 900 + self.count % 20)
+        report[25] = 40
+        return [bytes(report)]
+
+    def reply(self, data, status):
+        if data[:2] == bytes([0x10, 0x01]):
+            report = bytearray(64)
+            report[0] = 0x11
+            report[17:20] = bytes([2, 1, 0])
+            return [bytes(report)]
+        if data[:2] == bytes([0x74, 0x01]) and not self.streams:
+            return status()
+        return []
+
+
+class KrakenZ53(Kraken3):
+    pid = 0x3008
+    streams = False
+
+
+class Kraken2023(KrakenZ53):
+    pid = 0x300e
+
+
+class Smart2(Device):
+    pid = 0x2006
+    rdesc = vendor_rdesc([0x61, 0x67], [0x60, 0x62])
+    pwm_report = bytes([0x62])
+    fan_types = bytes([2, 1, 0] + [0] * 5)     # PWM, DC, none
+
+    def status(self):
+        self.count += 1
+        speed = bytearray(64)
+        speed[0:2] = bytes([0x67, 0x02])
+        speed[16:24] = self.fan_types
+        struct.pack_into('<3H', speed, 24, 1200 + self.count % 20, 800, 0)
+        speed[40:43] = bytes([50, 40, 40])
+        voltage = bytearray(64)
+        voltage[0:2] = bytes([0x67, 0x04])
+        voltage[16:24] = self.fan_types
+        struct.pack_into('<3H', voltage, 24, 12000, 11800, 12000)
+        struct.pack_into('<3H', voltage, 40, 150, 90, 0)
+        return [bytes(speed), bytes(voltage)]
+
+    def reply(self, data, status):
+        if data[:2] == bytes([0x60, 0x03]):
+            report = bytearray(64)
+            report[0:2] = bytes([0x61, 0x03])
+            report[16:24] = self.fan_types
+            return [bytes(report)]
+        return []
+
+
+DEVICES = {
+    'kraken2': Kraken2,
+    'grid3': Grid3,
+    'gridplus3': GridPlus3,
+    'kraken-x53': Kraken3,
+    'kraken-z53': KrakenZ53,
+    'kraken-2023': Kraken2023,
+    'smart2': Smart2,
+}
+
+
+class Uhid:
+    """A virtual HID device, answering output reports from a thread."""
+
+    def __init__(self, dev, replay=None):
+        self.dev = dev
+        self.replay = replay
+        self.replay_pos = 0
+        self.uniq = 'nzxt-uhid-{}'.format(os.getpid())
+        self.fd = os.open('/dev/uhid', os.O_RDWR)
+        self.lock = threading.Lock()
+        self.started = threading.Event()
+        self.pwm_received = threading.Condition()
+        self.pwm_time = None
+        self.outputs = 0
+
+    def _write(self, ev_type, payload):
+        ev = struct.pack('<I', ev_type) + payload
+        os.write(self.fd, ev.ljust(UHID_EVENT_SIZE, b'\0'))
+
+    def create(self):
+        rdesc = self.dev.rdesc
+        payload = struct.pack('<128s64s64sHHIIII', b'NZXT uhid ' + self.uniq.encode(),
+                              b'nzxt-uhid', self.uniq.encode(), len(rdesc), BUS_USB,
+                              VID_NZXT, self.dev.pid, 0, 0)
+        self._write(UHID_CREATE2, payload + rdesc)
+        threading.Thread(target=self._event_loop, daemon=True).start()
+
+    def destroy(self):
+        self._write(UHID_DESTROY, b'')
+        os.close(self.fd)
+
+    def status(self):
+        """Next status reports, from the recording if there is one."""
+        if not self.replay:
+            return self.dev.status()
+        report = self.replay[self.replay_pos]
+        self.replay_pos = (self.replay_pos + 1) % len(self.replay)
+        return [report]
+
+    def send(self, reports):
+        with self.lock:
+            for report in reports:
+                self._write(UHID_INPUT2, struct.pack('<H', len(report)) + report)
+
+    def _event_loop(self):
+        while True:
+            try:
+                ev = os.read(self.fd, UHID_EVENT_SIZE)
+            except OSError:
+                return
+            ev_type, = struct.unpack_from('<I', ev)
+            if ev_type == UHID_START:
+                self.started.set()
+            elif ev_type == UHID_OUTPUT:
+                size, = struct.unpack_from('<H', ev, 4 + UHID_DATA_MAX)
+                self._output(ev[4:4 + size])
+
+    def _output(self, data):
+        now = time.perf_counter_ns()
+        self.outputs += 1
+        if self.dev.pwm_report and data.startswith(self.dev.pwm_report):
+            with self.pwm_received:
+                self.pwm_time = now
+                self.pwm_received.notify_all()
+        self.send(self.dev.reply(data, self.status))
+
+    def stream(self, rate, stop):
+        """Sends status reports at rate reports/s until stop is set."""
+        period = 1 / rate
+        deadline = time.monotonic()
+        while not stop.is_set():
+            self.send(self.status())
+            deadline += period
+            stop.wait(max(0, deadline - time.monotonic()))
+
+    def hwmon_dir(self, timeout=10):
+        """Waits for the driver to bind and returns its hwmon directory."""
+        deadline = time.monotonic() + timeout
+        pattern = '/sys/bus/hid/devices/0003:{:04X}:{:04X}.*'.format(VID_NZXT, self.dev.pid)
+        while time.monotonic() < deadline:
+            for hid in glob.glob(pattern):
+                try:
+                    with open(os.path.join(hid, 'uevent')) as f:
+                        if 'HID_UNIQ={}\n'.format(self.uniq) not in f.read():
+                            continue
+                except OSError:
+                    continue
+                hwmon = glob.glob(os.path.join(hid, 'hwmon', 'hwmon*'))
+                if hwmon:
+                    return hwmon[0]
+            time.sleep(0.05)
+        raise TimeoutError('no hwmon device was registered (is the driver loaded?)')
+
+
+def read_attr(path):
+    with open(path, 'rb', buffering=0) as f:
+        return f.read(32)
+
+
+def summarize(name, samples_ns):
+    samples = sorted(s / 1000 for s in samples_ns)
+    p99 = samples[min(len(samples) - 1, int(len(samples) * 0.99))]
+    print('{}: n={} min={:.1f}us median={:.1f}us p99={:.1f}us max={:.1f}us'.format(
+        name, len(samples), samples[0], statistics.median(samples), p99, samples[-1]))
+
+
+def bench_read(path, count):
+    samples = []
+    for _ in range(count):
+        start = time.perf_counter_ns()
+        read_attr(path)
+        samples.append(time.perf_counter_ns() - start)
+    summarize('read latency of ' + os.path.basename(path), samples)
+
+
+def bench_concurrent(path, readers, duration):
+    counts = [0] * readers
+    stop = threading.Event()
+
+    def reader(i):
+        while not stop.is_set():
+            read_attr(path)
+            counts[i] += 1
+
+    threads = [threading.Thread(target=reader, args=(i,)) for i in range(readers)]
+    for thread in threads:
+        thread.start()
+    time.sleep(duration)
+    stop.set()
+    for thread in threads:
+        thread.join()
+    print('throughput of {} with {} readers: {:.0f} reads/s'.format(
+        os.path.basename(path), readers, sum(counts) / duration))
+
+
+def bench_write(uhid, path, count):
+    samples = []
+    for i in range(count):
+        value = b'128' if i % 2 else b'192'
+        with uhid.pwm_received:
+            uhid.pwm_time = None
+            start = time.perf_counter_ns()
+            with open(path, 'wb', buffering=0) as f:
+                f.write(value)
+            if not uhid.pwm_received.wait_for(lambda: uhid.pwm_time, timeout=2):
+                print('no duty report received after writing {}'.format(path))
+                continue
+            samples.append(uhid.pwm_time - start)
+    if samples:
+        summarize('write to report turnaround of ' + os.path.basename(path), samples)
+
+
+def load_replay(path):
+    with open(path) as f:
+        lines = [line.strip() for line in f]
+    return [bytes.fromhex(line) for line in lines if line and not line.startswith('#')]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0], epilog=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('device', choices=sorted(DEVICES))
+    parser.add_argument('--replay', metavar='FILE', help='input reports to replay')
+    parser.add_argument('--rate', type=float, default=2,
+                        help='update intervals per second, for streaming devices (default: 2)')
+    parser.add_argument('--bench', choices=['read', 'concurrent', 'write'])
+    parser.add_argument('--attr', default='fan1_input', help='attribute to read')
+    parser.add_argument('--pwm-attr', default='pwm1', help='attribute to write')
+    parser.add_argument('--count', type=int, default=1000, help='reads or writes to time')
+    parser.add_argument('--readers', type=int, default=4, help='concurrent readers')
+    parser.add_argument('--duration', type=float, default=10,
+                        help='duration of the concurrent benchmark, in s')
+    args = parser.parse_args()
+
+    dev = DEVICES[args.device]()
+    replay = load_replay(args.replay) if args.replay else None
+    uhid = Uhid(dev, replay)
+    stop = threading.Event()
+
+    uhid.create()
+    try:
+        if not uhid.started.wait(5):
+            raise TimeoutError('uhid device was not started')
+        if dev.streams:
+            threading.Thread(target=uhid.stream, args=(args.rate, stop), daemon=True).start()
+
+        hwmon = uhid.hwmon_dir()
+        print('{} bound as {}'.format(args.device, hwmon))
+
+        if args.bench == 'read':
+            bench_read(os.path.join(hwmon, args.attr), args.count)
+        elif args.bench == 'concurrent':
+            bench_concurrent(os.path.join(hwmon, args.attr), args.readers, args.duration)
+        elif args.bench == 'write':
+            bench_write(uhid, os.path.join(hwmon, args.pwm_attr), args.count)
+        else:
+            while True:
+                time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+    except (OSError, TimeoutError) as err:
+        print('error: {}'.format(err), file=sys.stderr)
+        return 1
+    finally:
+        stop.set()
+        print('{} output reports received'.format(uhid.outputs))
+        uhid.destroy()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())